@@ -0,0 +1,406 @@
+// 聊天服务器的压力测试客户端，用于对比单线程accept和SO_REUSEPORT多监听器两种模式
+// 1. 建连：多个线程同时建立连接并登录，统计每秒完成的连接数和连接+登录数，反映服务器的accept能力
+// 2. 吞吐：相邻的两个用户互发一对一聊天消息，每个线程最多有window条消息在途，统计每秒收到的消息数
+// 只使用socket接口和thirdparty中的json.hpp，测试用的用户需要已经注册并使用相同的密码，
+// 第一个用户id为0时先注册connections个新用户再测试
+#include "json.hpp"
+#include "public.hpp"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+using json = nlohmann::json;
+using namespace std;
+
+struct Options
+{
+    string ip;
+    uint16_t port = 0;
+    int connections = 1000; // 连接数量，同时也是登录的用户数量，取偶数
+    int threads = 4;        // 客户端线程数量
+    int duration = 10;      // 吞吐测试的秒数
+    int firstUserId = 0;    // 第一个用户的id，用户id连续；为0时先注册新用户
+    string password = "123456";
+    int window = 64; // 每个线程最多在途的消息数量
+};
+
+// 一个连接：socket和接收缓冲区
+struct Conn
+{
+    int fd = -1;
+    int userId = 0;
+    string input;
+};
+
+static double secondsSince(chrono::steady_clock::time_point begin)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+}
+
+// 发送一个带4字节长度前缀的消息帧，阻塞直到全部写入
+static bool sendFrame(int fd, const string &payload)
+{
+    uint32_t len = htonl(static_cast<uint32_t>(payload.size()));
+    string data(reinterpret_cast<const char *>(&len), 4);
+    data += payload;
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t ret = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (ret <= 0)
+        {
+            return false;
+        }
+        sent += static_cast<size_t>(ret);
+    }
+    return true;
+}
+
+// 从接收缓冲区中取出一个完整的消息帧，不完整返回false
+static bool takeFrame(string &input, string &payload)
+{
+    if (input.size() < 4)
+    {
+        return false;
+    }
+    uint32_t len = 0;
+    memcpy(&len, input.data(), 4);
+    len = ntohl(len);
+    if (input.size() < 4 + static_cast<size_t>(len))
+    {
+        return false;
+    }
+    payload.assign(input, 4, len);
+    input.erase(0, 4 + static_cast<size_t>(len));
+    return true;
+}
+
+// 阻塞读取下一个消息帧
+static bool recvFrame(Conn &conn, string &payload)
+{
+    char buf[64 * 1024];
+    while (!takeFrame(conn.input, payload))
+    {
+        ssize_t ret = recv(conn.fd, buf, sizeof(buf), 0);
+        if (ret <= 0)
+        {
+            return false;
+        }
+        conn.input.append(buf, static_cast<size_t>(ret));
+    }
+    return true;
+}
+
+// 等待msgid类型的响应，跳过其它消息
+static bool waitFor(Conn &conn, int msgid, json &response)
+{
+    string payload;
+    while (recvFrame(conn, payload))
+    {
+        response = json::parse(payload, nullptr, false);
+        if (!response.is_discarded() && response.value("msgid", 0) == msgid)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int connectTo(const Options &opt)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opt.port);
+    inet_pton(AF_INET, opt.ip.c_str(), &addr.sin_addr);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return fd;
+}
+
+// 注册count个新用户，返回第一个用户的id，新注册的用户id连续
+static int registerUsers(const Options &opt, int count)
+{
+    Conn conn;
+    conn.fd = connectTo(opt);
+    if (conn.fd < 0)
+    {
+        return 0;
+    }
+
+    int firstId = 0, lastId = 0;
+    string prefix = "bench" + to_string(time(nullptr)) + "_";
+    for (int i = 0; i < count; ++i)
+    {
+        json js;
+        js["msgid"] = REG_MSG;
+        js["name"] = prefix + to_string(i);
+        js["password"] = opt.password;
+        json response;
+        if (!sendFrame(conn.fd, js.dump()) || !waitFor(conn, REG_MSG_ACK, response) || response["errno"].get<int>() != 0)
+        {
+            firstId = 0;
+            break;
+        }
+
+        int id = response["id"].get<int>();
+        if (i == 0)
+        {
+            firstId = id;
+        }
+        else if (id != lastId + 1)
+        {
+            // 其它客户端同时注册导致id不连续
+            cerr << "registered user ids are not consecutive" << endl;
+            firstId = 0;
+            break;
+        }
+        lastId = id;
+    }
+    close(conn.fd);
+    return firstId;
+}
+
+// 建连测试：每个线程负责一段用户，依次连接并登录
+static void connectWorker(const Options &opt, vector<Conn> &conns, size_t begin, size_t end,
+                          atomic<int> &connected, atomic<int> &loggedIn, double &connectSeconds)
+{
+    auto start = chrono::steady_clock::now();
+    for (size_t i = begin; i < end; ++i)
+    {
+        conns[i].fd = connectTo(opt);
+        if (conns[i].fd >= 0)
+        {
+            ++connected;
+        }
+    }
+    connectSeconds = secondsSince(start);
+
+    for (size_t i = begin; i < end; ++i)
+    {
+        if (conns[i].fd < 0)
+        {
+            continue;
+        }
+        json js;
+        js["msgid"] = LOGIN_MSG;
+        js["id"] = conns[i].userId;
+        js["password"] = opt.password;
+        js["version"] = PROTOCOL_V2;
+        json response;
+        if (sendFrame(conns[i].fd, js.dump()) && waitFor(conns[i], LOGIN_MSG_ACK, response) && response["errno"].get<int>() == 0)
+        {
+            ++loggedIn;
+        }
+        else
+        {
+            close(conns[i].fd);
+            conns[i].fd = -1;
+        }
+    }
+}
+
+// 吞吐测试：线程内相邻的两个连接互发消息，窗口满了就等待接收
+static void chatWorker(const Options &opt, vector<Conn> &conns, size_t begin, size_t end,
+                       chrono::steady_clock::time_point deadline, atomic<uint64_t> &sentTotal, atomic<uint64_t> &receivedTotal)
+{
+    vector<size_t> active;
+    for (size_t i = begin; i + 1 < end; i += 2)
+    {
+        if (conns[i].fd >= 0 && conns[i + 1].fd >= 0)
+        {
+            active.push_back(i);
+            active.push_back(i + 1);
+        }
+    }
+    if (active.empty())
+    {
+        return;
+    }
+
+    vector<pollfd> fds;
+    for (size_t i : active)
+    {
+        fds.push_back({conns[i].fd, POLLIN, 0});
+    }
+
+    uint64_t sent = 0, received = 0;
+    size_t next = 0;
+    char buf[64 * 1024];
+    string payload;
+    bool failed = false;
+    while (!failed && chrono::steady_clock::now() < deadline)
+    {
+        // 窗口内轮流让每个连接给它的搭档发一条消息
+        while (!failed && sent - received < static_cast<uint64_t>(opt.window))
+        {
+            Conn &from = conns[active[next]];
+            Conn &to = conns[active[next] ^ 1];
+            next = (next + 1) % active.size();
+
+            json js;
+            js["msgid"] = ONE_CHAT_MSG;
+            js["id"] = from.userId;
+            js["name"] = "bench";
+            js["to"] = to.userId;
+            js["msg"] = "hello from the load generator";
+            js["time"] = "2026-01-01 00:00:00";
+            if (!sendFrame(from.fd, js.dump()))
+            {
+                cerr << "send failed, user " << from.userId << endl;
+                failed = true;
+                break;
+            }
+            ++sent;
+        }
+
+        if (failed || poll(fds.data(), fds.size(), 100) <= 0)
+        {
+            continue;
+        }
+        for (size_t k = 0; k < fds.size(); ++k)
+        {
+            if ((fds[k].revents & (POLLIN | POLLERR | POLLHUP)) == 0)
+            {
+                continue;
+            }
+            Conn &conn = conns[active[k]];
+            ssize_t ret = recv(conn.fd, buf, sizeof(buf), 0);
+            if (ret <= 0)
+            {
+                cerr << "connection closed, user " << conn.userId << endl;
+                failed = true;
+                break;
+            }
+            conn.input.append(buf, static_cast<size_t>(ret));
+            while (takeFrame(conn.input, payload))
+            {
+                json js = json::parse(payload, nullptr, false);
+                if (!js.is_discarded() && js.value("msgid", 0) == ONE_CHAT_MSG)
+                {
+                    ++received;
+                }
+            }
+        }
+    }
+    sentTotal += sent;
+    receivedTotal += received;
+}
+
+// 用法：ChatLoadGen ip port [连接数 线程数 测试秒数 第一个用户id 密码 每个线程的窗口]
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        cerr << "usage: " << argv[0] << " ip port [connections threads seconds first_user_id password window]\n"
+             << "  first_user_id 0 registers new users first" << endl;
+        return 1;
+    }
+
+    Options opt;
+    opt.ip = argv[1];
+    opt.port = static_cast<uint16_t>(atoi(argv[2]));
+    opt.connections = argc > 3 ? atoi(argv[3]) : opt.connections;
+    opt.threads = argc > 4 ? atoi(argv[4]) : opt.threads;
+    opt.duration = argc > 5 ? atoi(argv[5]) : opt.duration;
+    opt.firstUserId = argc > 6 ? atoi(argv[6]) : opt.firstUserId;
+    opt.password = argc > 7 ? argv[7] : opt.password;
+    opt.window = argc > 8 ? atoi(argv[8]) : opt.window;
+    opt.connections += opt.connections % 2;
+    opt.threads = max(1, min(opt.threads, opt.connections / 2));
+
+    if (opt.firstUserId == 0)
+    {
+        opt.firstUserId = registerUsers(opt, opt.connections);
+        if (opt.firstUserId == 0)
+        {
+            cerr << "register users failed" << endl;
+            return 1;
+        }
+        cout << "registered users " << opt.firstUserId << " - " << opt.firstUserId + opt.connections - 1 << endl;
+    }
+
+    vector<Conn> conns(static_cast<size_t>(opt.connections));
+    for (size_t i = 0; i < conns.size(); ++i)
+    {
+        conns[i].userId = opt.firstUserId + static_cast<int>(i);
+    }
+
+    // 每个线程负责偶数个连接，保证互发消息的两个连接在同一个线程中
+    vector<pair<size_t, size_t>> ranges;
+    size_t pairs = conns.size() / 2;
+    for (int t = 0; t < opt.threads; ++t)
+    {
+        size_t begin = pairs * t / opt.threads * 2;
+        size_t end = pairs * (t + 1) / opt.threads * 2;
+        ranges.emplace_back(begin, end);
+    }
+
+    // 1. 建连
+    atomic<int> connected{0}, loggedIn{0};
+    vector<double> connectSeconds(ranges.size());
+    vector<thread> workers;
+    auto start = chrono::steady_clock::now();
+    for (size_t t = 0; t < ranges.size(); ++t)
+    {
+        workers.emplace_back(connectWorker, cref(opt), ref(conns), ranges[t].first, ranges[t].second,
+                             ref(connected), ref(loggedIn), ref(connectSeconds[t]));
+    }
+    for (thread &worker : workers)
+    {
+        worker.join();
+    }
+    double totalSeconds = secondsSince(start);
+    double connectPhase = *max_element(connectSeconds.begin(), connectSeconds.end());
+    cout << "connections:" << connected << "/" << opt.connections << " in " << connectPhase << "s, "
+         << connected / connectPhase << " conn/s" << endl;
+    cout << "logged in:" << loggedIn << " in " << totalSeconds << "s, " << loggedIn / totalSeconds << " conn+login/s" << endl;
+
+    // 2. 吞吐
+    atomic<uint64_t> sent{0}, received{0};
+    workers.clear();
+    start = chrono::steady_clock::now();
+    auto deadline = start + chrono::seconds(opt.duration);
+    for (auto &range : ranges)
+    {
+        workers.emplace_back(chatWorker, cref(opt), ref(conns), range.first, range.second, deadline, ref(sent), ref(received));
+    }
+    for (thread &worker : workers)
+    {
+        worker.join();
+    }
+    totalSeconds = secondsSince(start);
+    cout << "chat messages sent:" << sent << " received:" << received << " in " << totalSeconds << "s, "
+         << received / totalSeconds << " msg/s" << endl;
+
+    for (Conn &conn : conns)
+    {
+        if (conn.fd >= 0)
+        {
+            close(conn.fd);
+        }
+    }
+    return 0;
+}
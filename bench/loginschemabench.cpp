@@ -0,0 +1,173 @@
+// LOGIN_MSG_ACK两种格式的对比：v1中好友、群组和群成员都是单独序列化的字符串，v2是嵌套的JSON对象
+// 模拟一个有1000个好友、100个群组、每个群组50个成员的用户，比较响应的字节数、服务器组织响应的耗时和客户端解析的耗时
+// 编译：g++ -std=c++17 -O2 -Ithirdparty bench/loginschemabench.cpp -o LoginSchemaBench
+#include "json.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+using json = nlohmann::json;
+using namespace std;
+
+// 与ChatService中相同：把JSON数组的每个元素单独序列化成字符串，用于v1协议的登录响应
+static json dumpElements(const json &arr)
+{
+    json result = json::array();
+    for (const json &elem : arr)
+    {
+        result.push_back(elem.dump());
+    }
+    return result;
+}
+
+// 构造好友和群组信息，字段与ChatService::login中的一致
+static void makeRoster(int friendNum, int groupNum, int memberNum, json &friends, json &groups)
+{
+    friends = json::array();
+    for (int i = 0; i < friendNum; ++i)
+    {
+        json js;
+        js["id"] = 10000 + i;
+        js["name"] = "user" + to_string(i);
+        js["state"] = i % 3 == 0 ? "online" : "offline";
+        friends.push_back(std::move(js));
+    }
+
+    groups = json::array();
+    for (int g = 0; g < groupNum; ++g)
+    {
+        json users = json::array();
+        for (int i = 0; i < memberNum; ++i)
+        {
+            json js;
+            js["id"] = 20000 + g * memberNum + i;
+            js["name"] = "member" + to_string(i);
+            js["state"] = "offline";
+            js["role"] = i == 0 ? "creator" : "normal";
+            users.push_back(std::move(js));
+        }
+
+        json group_js;
+        group_js["id"] = g;
+        group_js["groupname"] = "group" + to_string(g);
+        group_js["groupdesc"] = "benchmark group";
+        group_js["users"] = std::move(users);
+        groups.push_back(std::move(group_js));
+    }
+}
+
+// 服务器组织v1响应：每个元素单独序列化，群成员再嵌套一层
+static string buildV1(json friends, json groups)
+{
+    for (json &group_js : groups)
+    {
+        group_js["users"] = dumpElements(group_js["users"]);
+    }
+
+    json response;
+    response["msgid"] = 2;
+    response["errno"] = 0;
+    response["friends"] = dumpElements(friends);
+    response["groups"] = dumpElements(groups);
+    return response.dump();
+}
+
+// 服务器组织v2响应：嵌套的对象，整个响应只序列化一次
+static string buildV2(json friends, json groups)
+{
+    json response;
+    response["msgid"] = 2;
+    response["errno"] = 0;
+    response["version"] = 2;
+    response["friends"] = std::move(friends);
+    response["groups"] = std::move(groups);
+    return response.dump();
+}
+
+// 客户端解析v1响应：每个元素再解析一次，返回所有id的和，避免被优化掉
+static long parseV1(const string &data)
+{
+    long sum = 0;
+    json response = json::parse(data);
+    for (const json &str : response["friends"])
+    {
+        sum += json::parse(str.get<string>())["id"].get<int>();
+    }
+    for (const json &str : response["groups"])
+    {
+        json group_js = json::parse(str.get<string>());
+        for (const json &user : group_js["users"])
+        {
+            sum += json::parse(user.get<string>())["id"].get<int>();
+        }
+    }
+    return sum;
+}
+
+// 客户端解析v2响应：直接遍历嵌套的对象
+static long parseV2(const string &data)
+{
+    long sum = 0;
+    json response = json::parse(data);
+    for (const json &user : response["friends"])
+    {
+        sum += user["id"].get<int>();
+    }
+    for (const json &group_js : response["groups"])
+    {
+        for (const json &user : group_js["users"])
+        {
+            sum += user["id"].get<int>();
+        }
+    }
+    return sum;
+}
+
+// 多次执行fn，返回每次的平均毫秒数
+template <typename Fn>
+static double measure(int rounds, Fn fn)
+{
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i)
+    {
+        fn();
+    }
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, milli>(end - begin).count() / rounds;
+}
+
+// 用法：LoginSchemaBench [好友数量 群组数量 每个群组的成员数量 重复次数]
+int main(int argc, char **argv)
+{
+    int friendNum = argc > 1 ? atoi(argv[1]) : 1000;
+    int groupNum = argc > 2 ? atoi(argv[2]) : 100;
+    int memberNum = argc > 3 ? atoi(argv[3]) : 50;
+    int rounds = argc > 4 ? atoi(argv[4]) : 50;
+
+    json friends, groups;
+    makeRoster(friendNum, groupNum, memberNum, friends, groups);
+
+    string v1 = buildV1(friends, groups);
+    string v2 = buildV2(friends, groups);
+    if (parseV1(v1) != parseV2(v2))
+    {
+        cerr << "v1 and v2 responses differ!" << endl;
+        return 1;
+    }
+
+    long sink = 0;
+    double buildV1Ms = measure(rounds, [&]()
+                               { sink += buildV1(friends, groups).size(); });
+    double buildV2Ms = measure(rounds, [&]()
+                               { sink += buildV2(friends, groups).size(); });
+    double parseV1Ms = measure(rounds, [&]()
+                               { sink += parseV1(v1); });
+    double parseV2Ms = measure(rounds, [&]()
+                               { sink += parseV2(v2); });
+
+    cout << "friends:" << friendNum << " groups:" << groupNum << " members per group:" << memberNum << endl;
+    cout << "response bytes      v1:" << v1.size() << " v2:" << v2.size() << endl;
+    cout << "server build+dump   v1:" << buildV1Ms << "ms v2:" << buildV2Ms << "ms" << endl;
+    cout << "client parse+walk   v1:" << parseV1Ms << "ms v2:" << parseV2Ms << "ms" << endl;
+    return sink == 0 ? 1 : 0;
+}
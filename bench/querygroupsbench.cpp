@@ -0,0 +1,219 @@
+// GroupModel::queryGroups两种查询方式的对比，需要本地的MySQL（或MariaDB等兼容的数据库）
+// 原来的方式：先查用户所在的群组，再逐个群组查成员，加入N个群组时1 + N次查询
+// 现在的方式：一条联合查询同时查出群组和成员，1次查询
+// 在指定的数据库中创建BenchUser、BenchAllGroup、BenchGroupUser三张表并填充数据，结束后删除
+// 分别在GroupUser没有和有idx_user_id(user_id, group_id)索引时测量，对应README中的ALTER TABLE
+#include <mysql/mysql.h>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+struct Options
+{
+    string host = "127.0.0.1";
+    string user = "root";
+    string password = "123456";
+    string database = "chat";
+    int users = 10000;      // 用户数量
+    int groups = 2000;      // 群组数量
+    int groupsPerUser = 50; // 测试用户加入的群组数量
+    int members = 50;       // 每个群组的成员数量
+    int rounds = 200;       // 每种方式的查询次数
+};
+
+static MYSQL *_conn = nullptr;
+
+// 执行不需要结果的语句，失败时打印错误并退出，analyze等语句返回的结果直接丢弃
+static void exec(const string &sql)
+{
+    if (mysql_query(_conn, sql.c_str()) != 0)
+    {
+        cerr << "exec failed: " << mysql_error(_conn) << "\n  " << sql.substr(0, 200) << endl;
+        exit(1);
+    }
+    MYSQL_RES *res = mysql_store_result(_conn);
+    if (res != nullptr)
+    {
+        mysql_free_result(res);
+    }
+}
+
+// 执行查询并读完所有行，返回行数
+static int queryRows(const string &sql, vector<int> *firstColumn = nullptr)
+{
+    if (mysql_query(_conn, sql.c_str()) != 0)
+    {
+        cerr << "query failed: " << mysql_error(_conn) << "\n  " << sql << endl;
+        exit(1);
+    }
+    MYSQL_RES *res = mysql_store_result(_conn);
+    int rows = 0;
+    if (res != nullptr)
+    {
+        MYSQL_ROW row;
+        while ((row = mysql_fetch_row(res)) != nullptr)
+        {
+            if (firstColumn != nullptr)
+            {
+                firstColumn->push_back(atoi(row[0]));
+            }
+            ++rows;
+        }
+        mysql_free_result(res);
+    }
+    return rows;
+}
+
+// 分批插入，每条insert语句最多batch行
+static void insertRows(const string &prefix, const vector<string> &values, size_t batch = 1000)
+{
+    for (size_t i = 0; i < values.size(); i += batch)
+    {
+        string sql = prefix;
+        for (size_t j = i; j < values.size() && j < i + batch; ++j)
+        {
+            sql += j == i ? "" : ",";
+            sql += values[j];
+        }
+        exec(sql);
+    }
+}
+
+// 创建测试表并填充数据：测试用户加入前groupsPerUser个群组，每个群组有members个成员
+static void prepareTables(const Options &opt)
+{
+    exec("drop table if exists BenchGroupUser, BenchAllGroup, BenchUser");
+    exec("create table BenchUser(id int primary key, name varchar(50), password varchar(50))");
+    exec("create table BenchAllGroup(id int primary key, groupname varchar(50), groupdesc varchar(200))");
+    exec("create table BenchGroupUser(group_id int not null, user_id int not null, grouprole enum('creator','normal'), primary key(group_id, user_id))");
+
+    vector<string> values;
+    for (int i = 1; i <= opt.users; ++i)
+    {
+        values.push_back("(" + to_string(i) + ",'user" + to_string(i) + "','123456')");
+    }
+    insertRows("insert into BenchUser values", values);
+
+    values.clear();
+    for (int g = 1; g <= opt.groups; ++g)
+    {
+        values.push_back("(" + to_string(g) + ",'group" + to_string(g) + "','benchmark group')");
+    }
+    insertRows("insert into BenchAllGroup values", values);
+
+    // 第g个群组的成员是从(g * 7) % users开始的连续members个用户，群组之间成员分散
+    values.clear();
+    for (int g = 1; g <= opt.groups; ++g)
+    {
+        for (int m = 0; m < opt.members; ++m)
+        {
+            int user = (g * 7 + m) % opt.users + 1;
+            values.push_back("(" + to_string(g) + "," + to_string(user) + ",'" + (m == 0 ? "creator" : "normal") + "')");
+        }
+    }
+    insertRows("insert ignore into BenchGroupUser values", values);
+
+    // 测试用户从最后一个用户开始，每个加入groupsPerUser个群组
+    values.clear();
+    for (int u = 0; u < 10; ++u)
+    {
+        int user = opt.users - u;
+        for (int g = 1; g <= opt.groupsPerUser && g <= opt.groups; ++g)
+        {
+            int group = (u * opt.groupsPerUser + g - 1) % opt.groups + 1;
+            values.push_back("(" + to_string(group) + "," + to_string(user) + ",'normal')");
+        }
+    }
+    insertRows("insert ignore into BenchGroupUser values", values);
+    exec("analyze table BenchUser, BenchAllGroup, BenchGroupUser");
+}
+
+// 原来的方式：先查群组，再逐个群组查成员，返回读取的行数，queries中累加查询次数
+static int queryOld(int userId, int &queries)
+{
+    vector<int> groupIds;
+    queryRows("select a.id,a.groupname,a.groupdesc from BenchAllGroup a inner join BenchGroupUser b on a.id = b.group_id where b.user_id = " +
+                  to_string(userId),
+              &groupIds);
+    ++queries;
+
+    int rows = static_cast<int>(groupIds.size());
+    for (int groupId : groupIds)
+    {
+        rows += queryRows("select a.id,a.name,b.grouprole from BenchUser a inner join BenchGroupUser b on b.user_id = a.id where b.group_id = " +
+                          to_string(groupId));
+        ++queries;
+    }
+    return rows;
+}
+
+// 现在的方式：一条联合查询，返回读取的行数
+static int queryNew(int userId, int &queries)
+{
+    ++queries;
+    return queryRows("select a.id,a.groupname,a.groupdesc,u.id,u.name,c.grouprole "
+                     "from BenchGroupUser b inner join BenchAllGroup a on a.id = b.group_id "
+                     "inner join BenchGroupUser c on c.group_id = a.id "
+                     "inner join BenchUser u on u.id = c.user_id "
+                     "where b.user_id = " +
+                     to_string(userId) + " order by a.id");
+}
+
+// 执行rounds次查询，打印每次的平均耗时和查询次数
+static void measure(const char *name, const Options &opt, int (*fn)(int, int &))
+{
+    int queries = 0, rows = 0;
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < opt.rounds; ++i)
+    {
+        rows += fn(opt.users - i % 10, queries);
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count() / opt.rounds;
+    cout << "  " << name << ": " << ms << " ms/login, " << static_cast<double>(queries) / opt.rounds << " queries/login, "
+         << static_cast<double>(rows) / opt.rounds << " rows/login" << endl;
+}
+
+// 用法：QueryGroupsBench [host user password database 每个用户的群组数量 每个群组的成员数量 查询次数]
+int main(int argc, char **argv)
+{
+    Options opt;
+    opt.host = argc > 1 ? argv[1] : opt.host;
+    opt.user = argc > 2 ? argv[2] : opt.user;
+    opt.password = argc > 3 ? argv[3] : opt.password;
+    opt.database = argc > 4 ? argv[4] : opt.database;
+    opt.groupsPerUser = argc > 5 ? atoi(argv[5]) : opt.groupsPerUser;
+    opt.members = argc > 6 ? atoi(argv[6]) : opt.members;
+    opt.rounds = argc > 7 ? atoi(argv[7]) : opt.rounds;
+
+    _conn = mysql_init(nullptr);
+    if (mysql_real_connect(_conn, opt.host.c_str(), opt.user.c_str(), opt.password.c_str(), opt.database.c_str(), 3306, nullptr, 0) == nullptr)
+    {
+        cerr << "connect failed: " << mysql_error(_conn) << endl;
+        return 1;
+    }
+
+    prepareTables(opt);
+    cout << "users:" << opt.users << " groups:" << opt.groups << " groups per user:" << opt.groupsPerUser
+         << " members per group:" << opt.members << " rounds:" << opt.rounds << endl;
+
+    // 预热缓冲池，避免第一种方式承担冷数据的读取
+    int queries = 0;
+    queryOld(opt.users, queries);
+    queryNew(opt.users, queries);
+
+    cout << "without idx_user_id:" << endl;
+    measure("1 + N queries", opt, queryOld);
+    measure("single join  ", opt, queryNew);
+
+    exec("alter table BenchGroupUser add index idx_user_id(user_id, group_id)");
+    cout << "with idx_user_id:" << endl;
+    measure("1 + N queries", opt, queryOld);
+    measure("single join  ", opt, queryNew);
+
+    exec("drop table if exists BenchGroupUser, BenchAllGroup, BenchUser");
+    mysql_close(_conn);
+    return 0;
+}
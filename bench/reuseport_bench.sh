@@ -0,0 +1,57 @@
+#!/bin/bash
+# 对比单线程accept和SO_REUSEPORT多监听器两种模式的建连速率和消息吞吐
+# 每种模式依次用1、2、4、8……个IO线程启动服务器，直到最大IO线程数（默认CPU数），观察吞吐随线程数的变化
+# 需要mysql和redis已经启动，先用一次ChatLoadGen注册测试用户，之后传入第一个用户的id
+# 用法：bench/reuseport_bench.sh ChatServer路径 ChatLoadGen路径 第一个用户id [连接数 最大IO线程数 测试秒数 压测线程数]
+
+SERVER=$1
+LOADGEN=$2
+FIRST_USER=$3
+CONNECTIONS=${4:-2000}
+MAX_IO_THREADS=${5:-$(nproc)}
+SECONDS_PER_RUN=${6:-10}
+LOADGEN_THREADS=${7:-4}
+IP=127.0.0.1
+PORT=6100
+
+if [ -z "$SERVER" ] || [ -z "$LOADGEN" ] || [ -z "$FIRST_USER" ]; then
+    echo "usage: $0 ChatServer ChatLoadGen first_user_id [connections max_io_threads seconds loadgen_threads]"
+    exit 1
+fi
+
+# IO线程数：不超过最大值的2的幂，最大值不是2的幂时最后再测一次最大值
+LOOPS=""
+for ((n = 1; n <= MAX_IO_THREADS; n *= 2)); do
+    LOOPS="$LOOPS $n"
+    last=$n
+done
+if [ "$last" != "$MAX_IO_THREADS" ]; then
+    LOOPS="$LOOPS $MAX_IO_THREADS"
+fi
+
+# 用指定的IO线程数启动服务器，等待端口可以连接后运行压力测试，结束后停止服务器
+# 压测客户端的线程数固定，只改变服务器的IO线程数
+run() {
+    threads=$1
+    shift
+    echo "==== io_threads=$threads $* ===="
+    "$SERVER" -i $IP -p $PORT -t $threads --node-id reuseport-bench "$@" > /dev/null 2>&1 &
+    pid=$!
+    for i in $(seq 50); do
+        (echo > /dev/tcp/$IP/$PORT) 2> /dev/null && break
+        sleep 0.1
+    done
+    "$LOADGEN" $IP $PORT $CONNECTIONS $LOADGEN_THREADS $SECONDS_PER_RUN $FIRST_USER
+    kill -INT $pid
+    wait $pid 2> /dev/null
+}
+
+for threads in $LOOPS; do
+    run $threads --reuseport=false
+done
+for threads in $LOOPS; do
+    run $threads --reuseport
+done
+for threads in $LOOPS; do
+    run $threads --reuseport --cpu-affinity
+done
@@ -0,0 +1,259 @@
+#ifndef BINARYCODEC_H
+#define BINARYCODEC_H
+
+// server和client共用的二进制消息编解码，登录时协商使用，未协商的连接仍然使用JSON
+// 目前只有聊天消息(ONE_CHAT_MSG、GROUP_CHAT_MSG)使用二进制编码，其它消息仍然是JSON
+//
+// 消息格式（整数均为网络字节序）：
+// 1字节魔数kMagic + 2字节消息类型 + 4字节发送者id + 4字节接收者id(好友id或群组id) + 8字节时间戳(秒)
+// 之后是若干个字段：1字节字段标签 + 变长整数编码的字段长度 + 字段内容，不认识的字段直接跳过
+// JSON消息总是以'{'开头，接收方根据第一个字节区分两种编码
+//
+// 时间戳是把JSON消息中的时间字符串按UTC解释得到的秒数，编解码两端的时区不影响还原出的字符串
+// 只有能无损转换的JSON消息才使用二进制编码：字段类型不对、时间字符串不是规范格式、带有其它字段(如群消息的seq)时
+// fromJson返回false，调用方继续发送JSON
+
+#include "json.hpp"
+#include "public.hpp"
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+class BinaryCodec
+{
+public:
+    // 二进制消息的第一个字节
+    static const uint8_t kMagic = 0xB1;
+    // 固定头部的长度
+    static const size_t kHeaderLen = 1 + 2 + 4 + 4 + 8;
+
+    // 字段标签
+    enum Field : uint8_t
+    {
+        kFieldName = 1, // 发送者名字
+        kFieldMsg = 2,  // 消息内容
+    };
+
+    // 解码后的聊天消息
+    struct ChatMessage
+    {
+        int msgid = 0;
+        int32_t id = 0;
+        int32_t to = 0;
+        int64_t time = 0;
+        std::string name;
+        std::string msg;
+    };
+
+    // 消息是否是二进制编码
+    static bool isBinary(const char *data, size_t len)
+    {
+        return len > 0 && static_cast<uint8_t>(data[0]) == kMagic;
+    }
+
+    // 该类型的消息是否支持二进制编码
+    static bool supports(int msgid)
+    {
+        return msgid == ONE_CHAT_MSG || msgid == GROUP_CHAT_MSG;
+    }
+
+    // 编码一条聊天消息
+    static std::string encode(const ChatMessage &m)
+    {
+        std::string data;
+        data.reserve(kHeaderLen + 2 * 5 + m.name.size() + m.msg.size());
+        data.push_back(static_cast<char>(kMagic));
+        appendInt(data, static_cast<uint64_t>(m.msgid), 2);
+        appendInt(data, static_cast<uint32_t>(m.id), 4);
+        appendInt(data, static_cast<uint32_t>(m.to), 4);
+        appendInt(data, static_cast<uint64_t>(m.time), 8);
+        appendField(data, kFieldName, m.name);
+        appendField(data, kFieldMsg, m.msg);
+        return data;
+    }
+
+    // 解码一条聊天消息，格式错误返回false
+    static bool decode(const char *data, size_t len, ChatMessage &m)
+    {
+        if (len < kHeaderLen || !isBinary(data, len))
+        {
+            return false;
+        }
+
+        const char *p = data + 1;
+        m.msgid = static_cast<int>(readInt(p, 2));
+        m.id = static_cast<int32_t>(readInt(p + 2, 4));
+        m.to = static_cast<int32_t>(readInt(p + 6, 4));
+        m.time = static_cast<int64_t>(readInt(p + 10, 8));
+
+        const char *end = data + len;
+        p = data + kHeaderLen;
+        while (p < end)
+        {
+            uint8_t tag = static_cast<uint8_t>(*p++);
+            uint64_t fieldLen = 0;
+            if (!readVarint(p, end, fieldLen) || fieldLen > static_cast<uint64_t>(end - p))
+            {
+                return false;
+            }
+
+            if (tag == kFieldName)
+            {
+                m.name.assign(p, fieldLen);
+            }
+            else if (tag == kFieldMsg)
+            {
+                m.msg.assign(p, fieldLen);
+            }
+            p += fieldLen;
+        }
+        return supports(m.msgid);
+    }
+
+    // 从JSON格式的聊天消息转换，不支持的消息类型、缺少字段、字段类型不对、时间格式不规范或者带有其它字段时返回false
+    static bool fromJson(const nlohmann::json &js, ChatMessage &m)
+    {
+        if (!js.is_object() || !readInt32(js, "msgid", m.msgid) || !supports(m.msgid))
+        {
+            return false;
+        }
+
+        // 二进制编码只能携带这几个字段，多出的字段会在转换中丢失
+        const char *toKey = m.msgid == GROUP_CHAT_MSG ? "group_id" : "to";
+        if (js.size() != 6 || !readInt32(js, "id", m.id) || !readInt32(js, toKey, m.to) ||
+            !readString(js, "name", m.name) || !readString(js, "msg", m.msg))
+        {
+            return false;
+        }
+
+        std::string time;
+        return readString(js, "time", time) && parseTime(time, m.time);
+    }
+
+    // 转换成JSON格式的聊天消息，字段与客户端发送的JSON消息一致
+    static nlohmann::json toJson(const ChatMessage &m)
+    {
+        nlohmann::json js;
+        js["msgid"] = m.msgid;
+        js["id"] = m.id;
+        js["name"] = m.name;
+        js[m.msgid == GROUP_CHAT_MSG ? "group_id" : "to"] = m.to;
+        js["msg"] = m.msg;
+        js["time"] = formatTime(m.time);
+        return js;
+    }
+
+    // 时间戳转换成JSON消息中的时间字符串，按UTC格式化，与parseTime互逆
+    static std::string formatTime(int64_t time)
+    {
+        time_t tt = static_cast<time_t>(time);
+        struct tm tm;
+        char date[32] = {0};
+        if (gmtime_r(&tt, &tm) != nullptr)
+        {
+            strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+        }
+        return date;
+    }
+
+    // JSON消息中的时间字符串转换成时间戳，按UTC解释，不受本地时区和夏令时影响
+    // 格式错误或者不是formatTime能还原的规范格式时返回false
+    static bool parseTime(const std::string &str, int64_t &time)
+    {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        const char *end = strptime(str.c_str(), "%Y-%m-%d %H:%M:%S", &tm);
+        if (end == nullptr || *end != '\0')
+        {
+            return false;
+        }
+        time = static_cast<int64_t>(timegm(&tm));
+        return formatTime(time) == str;
+    }
+
+private:
+    // 读取JSON对象中的32位整数字段，字段不存在、不是整数或者超出范围返回false
+    template <typename Int>
+    static bool readInt32(const nlohmann::json &js, const char *key, Int &value)
+    {
+        auto it = js.find(key);
+        if (it == js.end() || !it->is_number_integer())
+        {
+            return false;
+        }
+        int64_t number = it->is_number_unsigned() && it->template get<uint64_t>() > static_cast<uint64_t>(INT32_MAX)
+                             ? static_cast<int64_t>(INT32_MAX) + 1
+                             : it->template get<int64_t>();
+        if (number < INT32_MIN || number > INT32_MAX)
+        {
+            return false;
+        }
+        value = static_cast<Int>(number);
+        return true;
+    }
+
+    // 读取JSON对象中的字符串字段，字段不存在或者不是字符串返回false
+    static bool readString(const nlohmann::json &js, const char *key, std::string &value)
+    {
+        auto it = js.find(key);
+        if (it == js.end() || !it->is_string())
+        {
+            return false;
+        }
+        value = it->get<std::string>();
+        return true;
+    }
+
+    // 追加bytes字节的大端整数
+    static void appendInt(std::string &data, uint64_t value, int bytes)
+    {
+        for (int i = bytes - 1; i >= 0; --i)
+        {
+            data.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+        }
+    }
+
+    // 读取bytes字节的大端整数
+    static uint64_t readInt(const char *p, int bytes)
+    {
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i)
+        {
+            value = (value << 8) | static_cast<uint8_t>(p[i]);
+        }
+        return value;
+    }
+
+    // 追加一个字段：标签 + 变长整数长度 + 内容
+    static void appendField(std::string &data, Field tag, const std::string &value)
+    {
+        data.push_back(static_cast<char>(tag));
+        uint64_t len = value.size();
+        while (len >= 0x80)
+        {
+            data.push_back(static_cast<char>((len & 0x7F) | 0x80));
+            len >>= 7;
+        }
+        data.push_back(static_cast<char>(len));
+        data.append(value);
+    }
+
+    // 读取变长整数，每个字节低7位是数据，最高位表示后面还有字节
+    static bool readVarint(const char *&p, const char *end, uint64_t &value)
+    {
+        value = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7)
+        {
+            uint8_t byte = static_cast<uint8_t>(*p++);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif
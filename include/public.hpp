@@ -17,6 +17,18 @@ enum EnMsgType
     ADD_GROUP_MSG,   // 加入群组
     GROUP_CHAT_MSG,  // 群聊天
 
+    OFFLINE_SYNC_MSG,     // 确认cursor之前的离线消息和groups中的群消息，并请求下一页离线消息
+    OFFLINE_SYNC_MSG_ACK, // 一页离线消息，带本页个人离线消息的cursor、群消息同步到的groups和是否还有更多
+    OFFLINE_ACK_MSG,      // 确认cursor之前的离线消息和groups中的群消息，不再请求下一页
+    OFFLINE_NOTIFY_MSG,   // 服务器通知客户端有新的离线消息（拥塞期间转存的聊天消息），客户端收到后同步离线消息
+
+};
+
+// 登录请求中的协议版本号，服务器按客户端声明的版本组织登录响应
+enum EnProtocolVersion
+{
+    PROTOCOL_V1 = 1, // 登录响应中的好友、群组、群成员都是单独序列化的JSON字符串
+    PROTOCOL_V2 = 2, // 登录响应中的好友、群组、群成员直接使用嵌套的JSON数组和对象
 };
 
 #endif
\ No newline at end of file
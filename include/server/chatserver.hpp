@@ -3,6 +3,11 @@
 
 #include <muduo/net/TcpServer.h>
 #include <muduo/net/EventLoop.h>
+#include <muduo/net/EventLoopThreadPool.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "workerpool.hpp"
 
 using namespace muduo;
 using namespace muduo::net;
@@ -15,10 +20,37 @@ public:
     ChatServer(EventLoop *loop,
                const InetAddress &listenAddr,
                const string &nameArg);
+    // 设置业务线程数量，在start之前调用
+    void setWorkerThreadNum(int numThreads);
+
+    // 设置IO线程数量，在start之前调用
+    void setIoThreadNum(int numThreads);
+
+    // 为true时每个IO线程各自用SO_REUSEPORT监听同一端口，由内核把新连接分配到各个线程，在start之前调用
+    void setReusePort(bool on);
+
+    // 为true时把IO线程依次绑定到各个CPU上，在start之前调用
+    void setCpuAffinity(bool on);
+
+    // 设置本节点在集群中的id，在start之前调用，不设置时使用主机名和监听地址生成
+    void setNodeId(const string &nodeId);
+
     // 启动服务
     void start();
 
 private:
+    // 生成默认的节点id：主机名:监听地址:端口，重启后不变
+    string defaultNodeId() const;
+
+    // 创建一个监听地址相同的TcpServer并注册回调
+    TcpServer *addServer(EventLoop *loop, const string &name, TcpServer::Option option);
+
+    // 读取进程允许使用的CPU，受taskset、cgroup cpuset等限制时只是在线CPU的一部分，编号也不一定连续
+    void loadAllowedCpus();
+
+    // IO线程启动时回调，按启动顺序把线程依次绑定到进程允许使用的CPU上
+    void pinThread(EventLoop *loop);
+
     // 上报链接相关信息的回调函数
     void onConnection(const TcpConnectionPtr &);
 
@@ -26,9 +58,40 @@ private:
     void onMessage(const TcpConnectionPtr &,
                    Buffer *,
                    Timestamp);
+
+    // 把连接上的业务投递到业务线程池，同一连接的业务总是在同一个工作线程中按顺序执行
+    void dispatch(const TcpConnectionPtr &conn, WorkerPool::Task task);
+
+    // 定期打印业务线程池的排队情况和缓存命中情况
+    void logMetrics();
+
+    // 消息帧长度前缀的字节数
+    static const size_t kHeaderLen = 4;
+    // 单个入站消息帧允许的最大长度，超过则认为是非法连接
+    static const size_t kMaxMessageLen = 1024 * 1024;
+    // 默认业务线程数量
+    static const int kDefaultWorkerThreadNum = 8;
+    // 默认IO线程数量
+    static const int kDefaultIoThreadNum = 4;
+    // 打印运行指标的时间间隔，单位秒
+    static constexpr double kMetricsInterval = 30.0;
+
     // 成员变量
-    TcpServer _server; // 组合的muduo库，实现服务器功能的类对象
-    EventLoop *_loop;  // 指向事件循环对象的指针
+    InetAddress _listenAddr; // 监听地址
+    string _name;            // 服务器名字
+    string _nodeId;          // 节点id，用于节点通道、在线状态和租约
+    EventLoop *_loop;        // 指向事件循环对象的指针
+    WorkerPool _workerPool;  // 业务线程池，执行会阻塞的数据库、redis操作
+    WorkerPool _backgroundPool; // 后台线程，执行较慢的定期任务，不占用处理连接消息的工作线程
+
+    int _ioThreadNum;                          // IO线程数量
+    bool _reusePort;                           // 是否每个IO线程各自监听
+    bool _cpuAffinity;                         // 是否把IO线程绑定到CPU
+    std::atomic<int> _nextCpu;                 // 下一个启动的IO线程绑定的CPU在_cpus中的序号
+    std::vector<int> _cpus;                    // 进程允许使用的CPU编号，start时读取
+    std::atomic<size_t> _nextConnId;           // 下一个连接的序号，用于选择工作线程
+    std::unique_ptr<EventLoopThreadPool> _listenerLoops; // SO_REUSEPORT模式下各个监听器所在的IO线程
+    std::vector<std::unique_ptr<TcpServer>> _servers;    // 组合的muduo库，SO_REUSEPORT模式下每个IO线程一个
 };
 
 #endif
\ No newline at end of file
@@ -1,8 +1,12 @@
 #ifndef CHATSERVICE_H
 #define CHATSERVICE_H
 
+#include <atomic>
 #include <unordered_map>
+#include <unordered_set>
 #include <functional>
+#include <memory>
+#include <string>
 #include <muduo/net/TcpServer.h>
 #include <mutex>
 #include "json.hpp"
@@ -13,10 +17,18 @@ using namespace muduo;
 using namespace muduo::net;
 
 #include "redis.hpp"
+#include "relayenvelope.hpp"
+#include "binarycodec.hpp"
+#include "onlineuserregistry.hpp"
+#include "session.hpp"
 #include "usermodel.hpp"
+#include "usercache.hpp"
+#include "presencemodel.hpp"
 #include "offlinemessagemodel.hpp"
 #include "friendmodel.hpp"
 #include "groupmodel.hpp"
+#include "groupcache.hpp"
+#include "groupmessagemodel.hpp"
 
 // 表示处理消息的事件回调方法类型
 using MsgHandler = std::function<void(const TcpConnectionPtr &conn, json &js, Timestamp)>;
@@ -29,18 +41,31 @@ public:
     // 获取单例对象的接口函数
     static ChatService *instance();
 
+    // 启动业务：连接redis服务器，订阅本节点的通道，nodeId在集群中唯一标识本服务器
+    void init(const string &nodeId);
+
     // 处理登录业务
     void login(const TcpConnectionPtr &conn, json &js, Timestamp time);
 
     // 处理注册业务
     void reg(const TcpConnectionPtr &conn, json &js, Timestamp time);
 
+    // 离线消息同步业务：确认cursor之前的离线消息和groups中的群消息，返回下一页
+    void offlineSync(const TcpConnectionPtr &conn, json &js, Timestamp time);
+
+    // 离线消息确认业务：删除cursor之前的离线消息，前移groups中的群组已读位置
+    void offlineAck(const TcpConnectionPtr &conn, json &js, Timestamp time);
+
     // 添加好友业务
     void addFriend(const TcpConnectionPtr &conn, json &js, Timestamp time);
 
     // 一对一聊天业务
     void oneChat(const TcpConnectionPtr &conn, json &js, Timestamp time);
 
+    // 转发一对一聊天消息，msg是已经校验过的完整JSON消息，不需要解析成json对象
+    // js是调用方已经解析好的消息，给协商了二进制编码的接收者编码时使用，快速路径没有解析时为nullptr
+    void forwardOneChat(const TcpConnectionPtr &conn, int toId, const string &msg, const json *js = nullptr);
+
     // 创建群组业务
     void creatGroup(const TcpConnectionPtr &conn, json &js, Timestamp time);
 
@@ -59,36 +84,179 @@ public:
     // 服务器异常，业务重置方法
     void reset();
 
+    // 续约本节点的在线状态租约，并删除租约已经到期的节点上的在线记录，需要定期调用
+    void refreshPresence();
+
+    // 删除所有成员都已经读过的群组时间线消息，需要定期在业务线程中调用
+    void pruneGroupMessages();
+
+    // 群组时间线的清理间隔，单位秒
+    static constexpr double kGroupMessagePruneInterval = 600.0;
+
     // 获取消息对应的处理器
     MsgHandler getHandler(int msgid);
 
     // 从redis消息队列中获取订阅的信息
-    void handleRedisSubscribeMessage(int, string);
+    void handleRedisSubscribeMessage(string channel, string data);
+
+    // 打开或关闭跨服务器转发消息的完整校验（扫描器加完整的JSON解析器），默认关闭，在init之前调用
+    void setRelayValidation(bool on);
 
-    // 通用发送函数：添加4字节长度前缀并发送JSON消息
+    // 通用发送函数：添加4字节长度前缀并发送JSON消息，协商了二进制编码的连接按二进制编码发送聊天消息
     void sendWithLengthPrefix(const TcpConnectionPtr &conn, json &js);
 
+    // 把序列化好的JSON字符串封装成带长度前缀的消息帧
+    static FramePtr makeFrame(const string &payload);
+
+    // 把已经解析的聊天消息编码成二进制消息帧，不支持二进制编码的消息直接返回原来的JSON消息帧
+    static FramePtr makeBinaryFrame(const json &js, const FramePtr &jsonFrame);
+
+    // 发送共享的消息帧，投递到连接所属的IO线程中发送，只拷贝智能指针不拷贝数据
+    void sendFrame(const TcpConnectionPtr &conn, const FramePtr &frame);
+
+    // 设置发送合并的延迟上限，单位秒，默认为0：只合并同一轮事件循环中的消息帧，在init之前调用
+    void setCorkDelay(double seconds);
+
+    // 发送的消息帧数量和合并后实际发送的次数
+    uint64_t sentFrames() const { return _sentFrames; }
+    uint64_t sentWrites() const { return _sentWrites; }
+
+    // 连接输出缓冲区超过高水位时由muduo在IO线程中回调，连接进入拥塞状态
+    void onHighWaterMark(const TcpConnectionPtr &conn, size_t len);
+
+    // 慢消费者统计：当前拥塞的连接数、转存为离线消息的消息帧数、因超过宽限期被断开的连接数
+    int congestedConns() const { return _congestedConns; }
+    uint64_t divertedFrames() const { return _divertedFrames; }
+    uint64_t slowConsumerCloses() const { return _slowConsumerCloses; }
+    // 上次调用以来单个连接输出缓冲区的最大字节数，调用后清零
+    size_t takeMaxBufferedBytes() { return _maxBufferedBytes.exchange(0); }
+
+    // 连接输出缓冲区的高水位，超过后连接进入拥塞状态
+    static const size_t kHighWaterMark = 1024 * 1024;
+
 private:
     // 构造函数私有化
     ChatService();
 
+    // 用户下线：把群消息已读位置前移到已经送达的位置，删除连接信息，删除在线状态
+    void userOffline(int user_id, const TcpConnectionPtr &conn);
+
+    // 用户下线时保存群组时间线的已读位置，只有同步范围之后的消息全部送达时才前移
+    void saveGroupCursors(int user_id, const SessionPtr &session);
+
+    // 读取还没有同步完的群组的时间线消息，最多limit条，groups中返回每个群组本页同步到的序号，全部同步完返回true
+    bool syncGroupMessages(const SessionPtr &session, int limit, vector<string> &msgs, json &groups);
+
+    // 前移客户端在groups中确认的群组已读位置，groups为群组id -> 已经收到的序号
+    void ackGroups(int user_id, const SessionPtr &session, const json &js);
+
+    // 登录期间加入的群组从加入时的已读位置开始记录送达状态
+    void trackJoinedGroup(const TcpConnectionPtr &conn, int user_id, int group_id);
+
+    // 批量查询好友和群成员中在线的用户
+    unordered_set<int> queryOnline(vector<User> &friends, vector<Group> &groups);
+
+    // 一条消息的接收者按所在位置分类的结果
+    struct Route
+    {
+        vector<pair<int, TcpConnectionPtr>> localVec;    // 本节点上的用户及其连接
+        unordered_map<string, vector<int>> nodeTargets; // 其它节点id -> 该节点上的用户
+        vector<int> offlineVec;                         // 不在线的用户
+    };
+
+    // 查找接收者所在的位置，只在查找本节点用户时短暂持有在线用户表各分片的锁
+    void routeTargets(const vector<int> &targets, Route &route);
+
+    // 把消息投递给本节点和其它节点上的在线接收者，不在线的接收者由调用方处理
+    // seq大于0时消息已经写入群组group_id的时间线，送达时记录到连接会话中
+    // js是msg解析好的消息，用于给协商了二进制编码的连接编码，没有时为nullptr
+    void fanOut(const Route &route, const string &msg, const json *js, int groupId = 0, int seq = 0);
+
+    // 把JSON消息帧发送给本节点上的多个连接，二进制编码的消息帧只创建一次，同一个IO线程上的连接只投递一次回调
+    // js是调用方已经解析好的消息，二进制消息帧从它编码；为nullptr时所有连接都发送JSON消息帧
+    void deliverLocal(const vector<pair<int, TcpConnectionPtr>> &localVec, const FramePtr &jsonFrame, const json *js,
+                      int groupId = 0, int seq = 0);
+
+    // 在连接所属的IO线程中调用，把消息帧加入连接的待发送队列，等待合并发送
+    // seq大于0表示群组groupId的时间线消息，写入连接或转存为离线消息时记录到会话中
+    void corkFrame(const TcpConnectionPtr &conn, const FramePtr &frame, int groupId = 0, int seq = 0);
+
+    // 在连接所属的IO线程中调用，把待发送队列中的消息帧合并成一次发送
+    void flushFrames(const TcpConnectionPtr &conn, const SessionPtr &session);
+
+    // 拥塞连接上的聊天消息转存为离线消息，不再写入输出缓冲区，其它消息返回false照常发送
+    bool divertFrame(const SessionPtr &session, const FramePtr &frame);
+
+    // 输出缓冲区降到低水位以下时解除拥塞状态，拥塞期间有消息转存时通知客户端同步离线消息
+    void clearCongestion(const TcpConnectionPtr &conn, const SessionPtr &session);
+
+    // 通知客户端有转存的离线消息，客户端收到后发起离线消息同步
+    void notifyOfflineSync(const TcpConnectionPtr &conn);
+
+    // 记录连接输出缓冲区的字节数，用于统计最大值
+    void recordBuffered(size_t bytes);
+
+    // 聊天消息中接收者读取的字段类型是否都正确，toKey是一对一聊天的to或群聊的group_id
+    static bool checkChatMessage(const json &js, const char *toKey);
+
+    // 节点通道名
+    static string nodeChannel(const string &nodeId);
+
+    // 把消息转发给其它节点上的用户，同一节点上的多个接收者合并成一条信封发布
+    // seq大于0时消息已经写入群组groupId的时间线，序号随信封发送，接收节点不需要扫描消息
+    // 发布失败或者目标节点没有订阅（节点已经退出）时给接收者存储离线消息，时间线上的消息不再存储
+    void relay(const string &nodeId, const vector<int> &targets, const string &msg, int groupId = 0, int seq = 0);
+
+    // 校验跨服务器转发的消息帧：合法的聊天消息，接收者读取的字段类型正确，群消息的序号与信封头部一致，仅在校验模式下调用
+    static bool validateRelayFrame(const char *payload, size_t payloadLen, int groupId, int seq);
+
+    // 离线消息同步时每页的消息数量
+    static const int kOfflinePageSize = 100;
+
     // 存储消息id和其对应的业务处理方法
     unordered_map<int, MsgHandler> _msgHandlerMap;
 
-    // 存储在线用户的通信连接
-    unordered_map<int, TcpConnectionPtr> _userConnMap;
-
-    // 定义互斥锁，保证_userConnMap的线程安全
-    mutex _connMutex;
+    // 存储在线用户的通信连接，内部按用户id分片加锁，保证线程安全
+    OnlineUserRegistry _onlineUsers;
 
     // 数据操作类对象
     UserModel _userModel;
     OfflineMsgModel _offlineMsgModel;
     FriendModel _friendModel;
     GroupModel _groupModel;
+    GroupMessageModel _groupMessageModel;
 
     // Redis操作对象
     Redis _redis;
+
+    // 用户在线状态的操作对象，保存在redis中
+    PresenceModel _presenceModel;
+
+    // 本服务器节点的id
+    string _nodeId;
+
+    // 是否校验跨服务器转发的消息内容，关闭时只校验信封结构和消息帧长度，仅用于调试
+    bool _validateRelay = false;
+
+    // 待发送的消息帧最多等待的时间，单位秒，为0时在本轮事件循环结束时发送
+    double _corkDelay = 0;
+    // 待发送的数据超过该字节数时立即发送，不再等待
+    static const size_t kMaxCorkBytes = 64 * 1024;
+
+    // 发送统计，在各个IO线程中更新
+    atomic<uint64_t> _sentFrames{0};
+    atomic<uint64_t> _sentWrites{0};
+
+    // 输出缓冲区降到该字节数以下时解除拥塞
+    static const size_t kLowWaterMark = kHighWaterMark / 2;
+    // 连接拥塞超过该秒数仍未降到低水位以下则断开
+    static constexpr double kSlowConsumerGrace = 30.0;
+
+    // 慢消费者统计，在各个IO线程中更新
+    atomic<int> _congestedConns{0};
+    atomic<uint64_t> _divertedFrames{0};
+    atomic<uint64_t> _slowConsumerCloses{0};
+    atomic<size_t> _maxBufferedBytes{0};
 };
 
 #endif
\ No newline at end of file
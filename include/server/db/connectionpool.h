@@ -0,0 +1,62 @@
+#ifndef CONNECTIONPOOL_H
+#define CONNECTIONPOOL_H
+
+#include "db.h"
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+#include <atomic>
+
+// MySQL数据库连接池，所有Model通过它借用连接，避免每次请求都重新建立TCP连接和认证
+class ConnectionPool
+{
+public:
+    // 获取连接池单例对象的接口函数
+    static ConnectionPool *instance();
+
+    // 从连接池中借用一个可用连接，超时返回nullptr
+    // 返回的智能指针析构时自动把连接归还到连接池，不会关闭连接
+    std::shared_ptr<MySQL> getConnection();
+
+    // 当前连接总数（空闲+借出）
+    size_t size();
+
+    // 当前空闲连接数
+    size_t idleSize();
+
+private:
+    // 构造函数私有化
+    ConnectionPool();
+    ~ConnectionPool();
+
+    // 创建一个新的数据库连接，失败返回nullptr
+    MySQL *createConnection();
+
+    // 归还连接，已断开的连接直接关闭
+    void releaseConnection(MySQL *conn);
+
+    // 在独立线程中定期回收空闲时间超过_maxIdleTime的多余连接
+    void scannerConnectionTask();
+
+    // 每个最大空闲时间内扫描的次数
+    static const int kScanPerIdleTime = 4;
+
+    size_t _initSize;       // 连接池最小连接数
+    size_t _maxSize;        // 连接池最大连接数
+    int _maxIdleTime;       // 连接最大空闲时间，单位秒
+    int _pingIdleTime;      // 借出前空闲超过该时间的连接需要先检测是否可用，单位秒
+    int _connectionTimeout; // 连接池无可用连接时的最大等待时间，单位毫秒
+
+    std::deque<MySQL *> _connectionQue; // 空闲连接队列，队尾是最近归还的连接
+    size_t _connectionCnt;              // 已创建的连接总数，包括借出的连接
+    std::mutex _queueMutex;             // 维护连接队列的线程安全
+    std::condition_variable _cv;        // 有连接归还时通知等待借用连接的线程
+    std::condition_variable _quitCv;    // 通知回收线程退出
+
+    std::atomic_bool _quit;     // 回收线程退出标志
+    std::thread _scannerThread; // 空闲连接回收线程
+};
+
+#endif
@@ -3,6 +3,81 @@
 
 #include <mysql/mysql.h>
 #include <string>
+#include <chrono>
+#include <vector>
+#include <unordered_map>
+#include <type_traits>
+
+class MySQL;
+
+// 预处理语句，参数和结果列都以二进制方式绑定，不需要把参数格式化成SQL文本，服务器也不需要重复解析SQL
+// 由MySQL::prepare创建，底层的MYSQL_STMT由连接缓存复用，Statement对象只在一次执行期间使用
+class Statement
+{
+public:
+    Statement(MySQL *mysql, MYSQL_STMT *stmt);
+    Statement(Statement &&other);
+    ~Statement();
+
+    Statement(const Statement &) = delete;
+    Statement &operator=(const Statement &) = delete;
+
+    // 语句是否预处理成功
+    bool valid() const { return _stmt != nullptr; }
+
+    // 绑定第index个参数，从0开始
+    void bindParam(int index, int value);
+    void bindParam(int index, const std::string &value);
+
+    // 把第index个结果列绑定到变量上，每次fetch成功后变量中就是当前行的值，NULL值读出为0或空字符串
+    void bindResult(int index, int *value);
+    void bindResult(int index, std::string *value);
+
+    // 执行语句
+    bool execute();
+
+    // 读取下一行结果，没有更多数据返回false
+    bool fetch();
+
+    // 插入操作生成的自增主键
+    my_ulonglong insertId();
+
+    // 插入、更新、删除操作影响的行数
+    my_ulonglong affectedRows();
+
+private:
+    // MYSQL_BIND中bool字段的实际类型，不同版本的客户端库分别是bool和my_bool
+    using bind_bool = std::remove_pointer<decltype(MYSQL_BIND::is_null)>::type;
+
+    // 一个参数的值，绑定时指向这里的存储
+    struct Param
+    {
+        enum_field_types type;
+        int intValue;
+        std::string strValue;
+        unsigned long length;
+    };
+
+    // 一个结果列绑定的变量和接收缓冲区
+    struct Result
+    {
+        int *intValue;
+        std::string *strValue;
+        std::vector<char> buffer;
+        unsigned long length;
+        bind_bool isNull;
+        bind_bool error;
+    };
+
+    // 记录执行错误，连接断开时标记连接不可用
+    void error(const char *op);
+
+    MySQL *_mysql;
+    MYSQL_STMT *_stmt;
+    std::vector<Param> _params;
+    std::vector<Result> _results;
+    std::vector<MYSQL_BIND> _resultBinds;
+};
 
 class MySQL
 {
@@ -25,9 +100,45 @@ public:
     // 获取连接
     MYSQL *getConnection();
 
+    // 检测连接是否可用
+    bool ping();
+
+    // 连接是否已经与服务器断开（根据最近一次操作的错误码判断）
+    bool isBroken();
+
+    // 刷新连接进入空闲状态的起始时间点
+    void refreshAliveTime();
+
+    // 返回连接已经空闲的时长，单位秒
+    double getIdleTime();
+
+    // 预处理语句，同一条SQL在该连接上只预处理一次，之后复用
+    Statement prepare(const std::string &sql);
+
+    // 开启事务，之后的语句在commit或rollback之前不会自动提交
+    bool begin();
+
+    // 提交事务，恢复自动提交
+    bool commit();
+
+    // 回滚事务，恢复自动提交
+    void rollback();
+
+    // 标记连接已经不可用，归还连接池时关闭
+    void setBroken() { _broken = true; }
+
 private:
     // 成员变量
     MYSQL *_conn;
+
+    // 连接已经不可用
+    bool _broken;
+
+    // 该连接上已经预处理过的语句，key为SQL
+    std::unordered_map<std::string, MYSQL_STMT *> _stmts;
+
+    // 连接进入空闲状态的起始时间点
+    std::chrono::steady_clock::time_point _alivetime;
 };
 
 #endif
\ No newline at end of file
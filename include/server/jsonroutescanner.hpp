@@ -0,0 +1,555 @@
+#ifndef JSONROUTESCANNER_H
+#define JSONROUTESCANNER_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// 不构建DOM的JSON扫描器，用于消息路由的快速路径
+// 一次遍历校验整个消息是合法的JSON对象（语法、转义、UTF-8编码与nlohmann::json的解析规则一致），
+// 同时取出顶层的msgid、to，以及群组时间线消息的group_id和seq字段，并记录接收者读取的id、name、msg、time字段的类型
+// 语法和字段类型都校验通过的消息可以不经过反序列化和序列化，直接把原始字节转发给接收者
+class JsonRouteScanner
+{
+public:
+    // 扫描消息，消息不是合法的JSON对象返回false
+    bool scan(const char *data, size_t len)
+    {
+        _p = data;
+        _end = data + len;
+        _hasMsgid = false;
+        _hasTo = false;
+        _hasGroupId = false;
+        _hasSeq = false;
+        _hasId = false;
+        _hasName = false;
+        _hasMsg = false;
+        _hasTime = false;
+        _escapedKey = false;
+
+        skipWs();
+        if (!parseObject(0))
+        {
+            return false;
+        }
+        skipWs();
+        return _p == _end;
+    }
+
+    // 顶层的msgid字段，不存在或不是整数时返回false
+    bool msgid(int &value) const
+    {
+        value = _msgid;
+        return _hasMsgid;
+    }
+
+    // 顶层的to字段，不存在或不是整数时返回false
+    bool to(int &value) const
+    {
+        value = _to;
+        return _hasTo;
+    }
+
+    // 顶层的group_id字段，不存在或不是整数时返回false
+    bool groupId(int &value) const
+    {
+        value = _groupId;
+        return _hasGroupId;
+    }
+
+    // 顶层的seq字段，只有写入了群组时间线的群消息才有，不存在或不是整数时返回false
+    bool seq(int &value) const
+    {
+        value = _seq;
+        return _hasSeq;
+    }
+
+    // 顶层的id字段(发送者)，不存在或不是整数时返回false
+    bool id(int &value) const
+    {
+        value = _id;
+        return _hasId;
+    }
+
+    // 聊天消息中接收者读取的字段类型是否都正确：id是int范围内的整数，name、msg、time都是字符串
+    // 顶层有带转义的键名时无法确定它对应哪个字段，同样返回false，由完整解析处理
+    bool chatFields() const
+    {
+        return _hasId && _hasName && _hasMsg && _hasTime && !_escapedKey;
+    }
+
+private:
+    // 嵌套层数的上限，超过则认为不适合快速路径，退回到完整解析
+    static const int kMaxDepth = 64;
+
+    void skipWs()
+    {
+        while (_p < _end && (*_p == ' ' || *_p == '\t' || *_p == '\n' || *_p == '\r'))
+        {
+            ++_p;
+        }
+    }
+
+    bool consume(char c)
+    {
+        skipWs();
+        if (_p < _end && *_p == c)
+        {
+            ++_p;
+            return true;
+        }
+        return false;
+    }
+
+    bool parseValue(int depth)
+    {
+        skipWs();
+        if (_p >= _end)
+        {
+            return false;
+        }
+
+        switch (*_p)
+        {
+        case '{':
+            return parseObject(depth + 1);
+        case '[':
+            return parseArray(depth + 1);
+        case '"':
+            return parseString(nullptr, nullptr);
+        case 't':
+            return parseLiteral("true");
+        case 'f':
+            return parseLiteral("false");
+        case 'n':
+            return parseLiteral("null");
+        default:
+            return parseNumber(nullptr, nullptr);
+        }
+    }
+
+    bool parseObject(int depth)
+    {
+        if (depth > kMaxDepth || !consume('{'))
+        {
+            return false;
+        }
+        if (consume('}'))
+        {
+            return true;
+        }
+
+        do
+        {
+            skipWs();
+            const char *key = nullptr;
+            size_t keyLen = 0;
+            if (!parseString(&key, &keyLen) || !consume(':'))
+            {
+                return false;
+            }
+
+            // 只记录顶层的路由字段，键名按原始字节比较，带转义的键名不会匹配，记录下来由调用方退回到完整解析
+            if (depth == 0 && memchr(key, '\\', keyLen) != nullptr)
+            {
+                _escapedKey = true;
+                if (!parseValue(depth))
+                {
+                    return false;
+                }
+            }
+            else if (depth == 0 && keyLen == 5 && memcmp(key, "msgid", 5) == 0)
+            {
+                skipWs();
+                if (!parseNumber(&_msgid, &_hasMsgid))
+                {
+                    return false;
+                }
+            }
+            else if (depth == 0 && keyLen == 2 && memcmp(key, "to", 2) == 0)
+            {
+                skipWs();
+                if (!parseNumber(&_to, &_hasTo))
+                {
+                    return false;
+                }
+            }
+            else if (depth == 0 && keyLen == 8 && memcmp(key, "group_id", 8) == 0)
+            {
+                skipWs();
+                if (!parseNumber(&_groupId, &_hasGroupId))
+                {
+                    return false;
+                }
+            }
+            else if (depth == 0 && keyLen == 3 && memcmp(key, "seq", 3) == 0)
+            {
+                skipWs();
+                if (!parseNumber(&_seq, &_hasSeq))
+                {
+                    return false;
+                }
+            }
+            else if (depth == 0 && keyLen == 2 && memcmp(key, "id", 2) == 0)
+            {
+                if (!parseIntField(&_id, &_hasId))
+                {
+                    return false;
+                }
+            }
+            else if (depth == 0 && keyLen == 4 && memcmp(key, "name", 4) == 0)
+            {
+                if (!parseStringField(&_hasName))
+                {
+                    return false;
+                }
+            }
+            else if (depth == 0 && keyLen == 3 && memcmp(key, "msg", 3) == 0)
+            {
+                if (!parseStringField(&_hasMsg))
+                {
+                    return false;
+                }
+            }
+            else if (depth == 0 && keyLen == 4 && memcmp(key, "time", 4) == 0)
+            {
+                if (!parseStringField(&_hasTime))
+                {
+                    return false;
+                }
+            }
+            else if (!parseValue(depth))
+            {
+                return false;
+            }
+        } while (consume(','));
+
+        return consume('}');
+    }
+
+    // 解析顶层的整数字段，值是其它类型时仍然校验语法，isInt置为false
+    bool parseIntField(int *value, bool *isInt)
+    {
+        skipWs();
+        *isInt = false;
+        if (_p < _end && (*_p == '-' || (*_p >= '0' && *_p <= '9')))
+        {
+            return parseNumber(value, isInt);
+        }
+        return parseValue(0);
+    }
+
+    // 解析顶层的字符串字段，值是其它类型时仍然校验语法，isString置为false
+    bool parseStringField(bool *isString)
+    {
+        skipWs();
+        *isString = _p < _end && *_p == '"';
+        return parseValue(0);
+    }
+
+    bool parseArray(int depth)
+    {
+        if (depth > kMaxDepth || !consume('['))
+        {
+            return false;
+        }
+        if (consume(']'))
+        {
+            return true;
+        }
+
+        do
+        {
+            if (!parseValue(depth))
+            {
+                return false;
+            }
+        } while (consume(','));
+
+        return consume(']');
+    }
+
+    bool parseLiteral(const char *literal)
+    {
+        size_t len = strlen(literal);
+        if (static_cast<size_t>(_end - _p) < len || memcmp(_p, literal, len) != 0)
+        {
+            return false;
+        }
+        _p += len;
+        return true;
+    }
+
+    // 解析数字，value不为空时，数字是int范围内的整数则写入value并把isInt置为true
+    // 路由字段的值不是数字时也返回false，交给完整解析报告错误
+    bool parseNumber(int *value, bool *isInt)
+    {
+        const char *begin = _p;
+        bool negative = false;
+        if (_p < _end && *_p == '-')
+        {
+            negative = true;
+            ++_p;
+        }
+
+        // 整数部分：0或者不以0开头的数字串
+        int64_t integer = 0;
+        bool overflow = false;
+        if (_p < _end && *_p == '0')
+        {
+            ++_p;
+        }
+        else if (_p < _end && *_p >= '1' && *_p <= '9')
+        {
+            while (_p < _end && *_p >= '0' && *_p <= '9')
+            {
+                if (!overflow)
+                {
+                    integer = integer * 10 + (*_p - '0');
+                    overflow = integer > INT32_MAX + 1LL;
+                }
+                ++_p;
+            }
+        }
+        else
+        {
+            return false;
+        }
+
+        bool fraction = false;
+        if (_p < _end && *_p == '.')
+        {
+            fraction = true;
+            ++_p;
+            if (!digits())
+            {
+                return false;
+            }
+        }
+        if (_p < _end && (*_p == 'e' || *_p == 'E'))
+        {
+            fraction = true;
+            ++_p;
+            if (_p < _end && (*_p == '+' || *_p == '-'))
+            {
+                ++_p;
+            }
+            if (!digits())
+            {
+                return false;
+            }
+        }
+
+        // 浮点数超出double范围时nlohmann::json会解析失败，这里保持一致
+        if (fraction && !std::isfinite(strtod(std::string(begin, _p).c_str(), nullptr)))
+        {
+            return false;
+        }
+
+        if (value != nullptr)
+        {
+            integer = negative ? -integer : integer;
+            *isInt = !fraction && !overflow && integer >= INT32_MIN && integer <= INT32_MAX;
+            *value = *isInt ? static_cast<int>(integer) : 0;
+        }
+        return true;
+    }
+
+    // 至少一个十进制数字
+    bool digits()
+    {
+        const char *begin = _p;
+        while (_p < _end && *_p >= '0' && *_p <= '9')
+        {
+            ++_p;
+        }
+        return _p > begin;
+    }
+
+    // 解析字符串，校验转义序列和UTF-8编码，key不为空时返回引号内的原始字节
+    bool parseString(const char **key, size_t *keyLen)
+    {
+        if (_p >= _end || *_p != '"')
+        {
+            return false;
+        }
+        const char *begin = ++_p;
+
+        while (_p < _end)
+        {
+            unsigned char c = static_cast<unsigned char>(*_p);
+            if (c == '"')
+            {
+                if (key != nullptr)
+                {
+                    *key = begin;
+                    *keyLen = static_cast<size_t>(_p - begin);
+                }
+                ++_p;
+                return true;
+            }
+            if (c < 0x20)
+            {
+                // 字符串中不能出现未转义的控制字符
+                return false;
+            }
+            if (c == '\\')
+            {
+                if (!parseEscape())
+                {
+                    return false;
+                }
+                continue;
+            }
+            if (c >= 0x80)
+            {
+                if (!parseUtf8())
+                {
+                    return false;
+                }
+                continue;
+            }
+            ++_p;
+        }
+        return false;
+    }
+
+    // 解析转义序列，\u转义的代理对必须成对出现
+    bool parseEscape()
+    {
+        ++_p;
+        if (_p >= _end)
+        {
+            return false;
+        }
+
+        char c = *_p++;
+        if (c == '"' || c == '\\' || c == '/' || c == 'b' || c == 'f' || c == 'n' || c == 'r' || c == 't')
+        {
+            return true;
+        }
+        if (c != 'u')
+        {
+            return false;
+        }
+
+        int code = hex4();
+        if (code < 0)
+        {
+            return false;
+        }
+        if (code >= 0xDC00 && code <= 0xDFFF)
+        {
+            return false;
+        }
+        if (code >= 0xD800 && code <= 0xDBFF)
+        {
+            if (_end - _p < 2 || _p[0] != '\\' || _p[1] != 'u')
+            {
+                return false;
+            }
+            _p += 2;
+            int low = hex4();
+            return low >= 0xDC00 && low <= 0xDFFF;
+        }
+        return true;
+    }
+
+    // 读取4位十六进制数，格式错误返回-1
+    int hex4()
+    {
+        if (_end - _p < 4)
+        {
+            return -1;
+        }
+
+        int code = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            char c = *_p++;
+            code <<= 4;
+            if (c >= '0' && c <= '9')
+            {
+                code |= c - '0';
+            }
+            else if (c >= 'a' && c <= 'f')
+            {
+                code |= c - 'a' + 10;
+            }
+            else if (c >= 'A' && c <= 'F')
+            {
+                code |= c - 'A' + 10;
+            }
+            else
+            {
+                return -1;
+            }
+        }
+        return code;
+    }
+
+    // 校验一个多字节UTF-8字符：不能是超长编码、代理区码点或超过U+10FFFF
+    bool parseUtf8()
+    {
+        unsigned char c = static_cast<unsigned char>(*_p);
+        int count = 0;
+        unsigned char lower = 0x80, upper = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF)
+        {
+            count = 1;
+        }
+        else if (c >= 0xE0 && c <= 0xEF)
+        {
+            count = 2;
+            lower = c == 0xE0 ? 0xA0 : 0x80;
+            upper = c == 0xED ? 0x9F : 0xBF;
+        }
+        else if (c >= 0xF0 && c <= 0xF4)
+        {
+            count = 3;
+            lower = c == 0xF0 ? 0x90 : 0x80;
+            upper = c == 0xF4 ? 0x8F : 0xBF;
+        }
+        else
+        {
+            return false;
+        }
+
+        if (_end - _p <= count)
+        {
+            return false;
+        }
+        ++_p;
+        for (int i = 0; i < count; ++i)
+        {
+            unsigned char next = static_cast<unsigned char>(*_p++);
+            if (next < (i == 0 ? lower : 0x80) || next > (i == 0 ? upper : 0xBF))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const char *_p = nullptr;
+    const char *_end = nullptr;
+    int _msgid = 0;
+    bool _hasMsgid = false;
+    int _to = 0;
+    bool _hasTo = false;
+    int _groupId = 0;
+    bool _hasGroupId = false;
+    int _seq = 0;
+    bool _hasSeq = false;
+    int _id = 0;
+    bool _hasId = false;
+    bool _hasName = false;
+    bool _hasMsg = false;
+    bool _hasTime = false;
+    bool _escapedKey = false;
+};
+
+#endif
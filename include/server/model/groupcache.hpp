@@ -0,0 +1,100 @@
+#ifndef GROUPCACHE_H
+#define GROUPCACHE_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// 群组成员的进程内索引，按群组id分片，每个分片是一个带过期时间的LRU链表，每个群组保存一个有序的成员id数组
+// 群聊时直接从索引中取成员，未命中再查数据库；成员变化时在原数据的副本上修改后替换，读者持有的旧数组不受影响
+class GroupCache
+{
+public:
+    // 只读的成员id数组，按id升序排列
+    using MemberList = shared_ptr<const vector<int>>;
+
+    // 获取单例对象的接口函数
+    static GroupCache *instance();
+
+    // 查询群组成员，命中返回true
+    bool get(int group_id, MemberList &members);
+
+    // 群组所在分片的版本号，从数据库加载成员之前获取，写入时用于判断加载期间数据是否被修改过
+    uint64_t version(int group_id);
+
+    // 写入从数据库加载的群组成员，加载期间分片被修改过则放弃写入
+    void put(int group_id, vector<int> members, uint64_t version);
+
+    // 新创建的群组，成员为空
+    void createGroup(int group_id);
+
+    // 群组增加成员，群组不在索引中则忽略，下次查询时从数据库加载
+    void addMember(int group_id, int user_id);
+
+    // 删除本节点索引中的群组
+    void invalidate(int group_id);
+
+    // 群组成员被本节点修改，通知其它节点删除索引
+    void notifyChanged(int group_id);
+
+    // 设置通知其它节点删除索引的回调，由业务层通过redis通道广播
+    void setInvalidateNotifier(function<void(int)> notifier);
+
+    // 索引命中次数
+    uint64_t hits() const { return _hits; }
+
+    // 索引未命中次数
+    uint64_t misses() const { return _misses; }
+
+    // 索引中的群组数量
+    size_t size();
+
+    // 索引占用内存的估计值，单位字节
+    size_t memoryUsage();
+
+private:
+    GroupCache();
+
+    using Clock = chrono::steady_clock;
+
+    // 索引项：群组id、成员数组和过期时间
+    struct Entry
+    {
+        int group_id;
+        MemberList members;
+        Clock::time_point expire;
+    };
+
+    // 一个分片，链表头部是最近使用的群组，version在分片中任何群组被修改时递增
+    struct Shard
+    {
+        mutex mtx;
+        list<Entry> lru;
+        unordered_map<int, list<Entry>::iterator> groups;
+        uint64_t version = 0;
+    };
+
+    Shard &getShard(int group_id) { return _shards[static_cast<size_t>(group_id) % kShardCount]; }
+
+    // 把群组成员写入分片并移到链表头部，加锁后调用
+    void store(Shard &shard, int group_id, MemberList members);
+
+    static const size_t kShardCount = 16;
+    // 每个分片最多索引的群组数量
+    static const size_t kShardCapacity = 4096;
+    // 索引数据的有效时间，错过其它节点的失效通知时，最多使用这么久的旧成员列表
+    static const chrono::seconds kTTL;
+
+    Shard _shards[kShardCount];
+    atomic<uint64_t> _hits;
+    atomic<uint64_t> _misses;
+    function<void(int)> _notifier;
+};
+
+#endif
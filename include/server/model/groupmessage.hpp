@@ -0,0 +1,31 @@
+#ifndef GROUPMESSAGE_H
+#define GROUPMESSAGE_H
+
+#include <string>
+using namespace std;
+
+// 匹配GroupMessage表的ORM类，seq是消息在群组内的序号，从1开始单调递增
+class GroupMessage
+{
+public:
+    GroupMessage(int groupid = -1, int seq = 0, string message = "")
+    {
+        this->groupid = groupid;
+        this->seq = seq;
+        this->message = message;
+    }
+    void setGroupId(int groupid) { this->groupid = groupid; }
+    void setSeq(int seq) { this->seq = seq; }
+    void setMessage(string message) { this->message = message; }
+
+    int getGroupId() { return this->groupid; }
+    int getSeq() { return this->seq; }
+    string getMessage() { return this->message; }
+
+private:
+    int groupid;
+    int seq;
+    string message;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef GROUPMESSAGEMODEL_H
+#define GROUPMESSAGEMODEL_H
+
+#include "groupmessage.hpp"
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// 群组消息时间线的操作接口方法
+// 每条群消息只存储一次，按群组内的序号排列；每个成员在GroupCursor表中记录自己已读到的序号
+// 成员登录后通过离线消息同步分页读取序号大于已读位置的消息，代替给每个离线成员各存一份离线消息
+// 只有群消息发送时有成员不在线才写入时间线，所有成员的已读位置都越过的消息定期删除
+class GroupMessageModel
+{
+public:
+    // 为群组分配下一条消息的序号，失败返回-1
+    int nextSeq(int group_id);
+
+    // 把分配了序号的群消息写入时间线
+    bool insert(int group_id, int seq, const string &msg);
+
+    // 查询用户所有群组的已读位置和最新序号：群组id -> (已读位置, 最新序号)，用户登录时调用
+    unordered_map<int, pair<int, int>> querySyncRanges(int user_id);
+
+    // 查询用户在群组中的已读位置，没有记录返回0
+    int queryCursor(int user_id, int group_id);
+
+    // 按序号顺序读取群组中序号在(after, upTo]之间的消息，最多limit条
+    vector<GroupMessage> queryRange(int group_id, int after, int upTo, int limit);
+
+    // 统计多个群组中序号在(after, upTo]之间的消息数量，ranges为群组id -> (after, upTo)，返回群组id -> 数量
+    unordered_map<int, int> countRanges(const unordered_map<int, pair<int, int>> &ranges);
+
+    // 把用户在多个群组中的已读位置前移，seqs为群组id到序号的映射，已读位置只前移不后退
+    void advanceCursors(int user_id, const unordered_map<int, int> &seqs);
+
+    // 用户加入群组，已读位置从群组的最新序号开始，不读取加入之前的历史消息
+    void initCursor(int user_id, int group_id);
+
+    // 给用户还没有已读位置的群组（时间线上线之前加入的群组）补上记录，从群组的最新序号开始，用户登录时调用
+    void initCursors(int user_id);
+
+    // 删除所有成员的已读位置都已经越过的群消息，返回删除的行数，定期调用
+    int prune();
+
+private:
+    // 统计消息数量和前移已读位置时一条语句最多携带的群组数量，超过则拆分成多条语句
+    static const size_t kMaxGroupsPerStatement = 64;
+};
+
+#endif
@@ -25,6 +25,10 @@ public:
 
     // 根据指定的group_id查询群组用户id列表，除user_id自己，主要用户群聊业务给群组其它成员群发消息
     vector<int> queryGroupUsers(int user_id, int group_id);
+
+private:
+    // 从数据库加载群组的所有成员，并写入成员索引
+    vector<int> loadGroupUsers(int group_id);
 };
 
 #endif
\ No newline at end of file
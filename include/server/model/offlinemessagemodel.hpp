@@ -2,19 +2,26 @@
 #define OFFLINEMESSAGEMODEL_H
 #include <string>
 #include <vector>
+#include <utility>
 
 // 提供离线消息表的操作接口方法
 class OfflineMsgModel
 {
 public:
-    // 存取用户的离线消息
+    // 存取用户的离线消息，先放入写入队列，由OfflineMsgBatcher批量写入数据库
     void insert(int user_id, std::string msg);
 
-    // 删除用户的离线消息
-    void remove(int user_id);
+    // 给多个用户存储同一条离线消息，多个用户共享同一份消息内容
+    void insert(const std::vector<int> &user_ids, const std::string &msg);
 
-    // 查询用户的离线消息
-    std::vector<std::string> query(int user_id);
+    // 等待之前存储的离线消息全部写入数据库，读取离线消息之前调用
+    bool flush();
+
+    // 删除用户id不大于max_id的离线消息，客户端确认收到之后调用
+    void remove(int user_id, int max_id);
+
+    // 分页查询用户id大于after_id的离线消息，最多limit条，按id排序，返回消息id和消息内容
+    std::vector<std::pair<int, std::string>> query(int user_id, int after_id, int limit);
 };
 
 #endif
\ No newline at end of file
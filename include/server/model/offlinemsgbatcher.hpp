@@ -0,0 +1,96 @@
+#ifndef OFFLINEMSGBATCHER_H
+#define OFFLINEMSGBATCHER_H
+
+#include "connectionpool.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// 离线消息的延迟批量写入器
+// IO线程和业务线程存储离线消息时只放入内存队列，由独立线程把队列中的消息用多行INSERT在一个事务中写入数据库
+// 队列达到kMaxBatchSize条或最早的消息等待超过kFlushInterval时写入一次
+class OfflineMsgBatcher
+{
+public:
+    // 获取单例对象的接口函数
+    static OfflineMsgBatcher *instance();
+
+    // 给多个用户存储同一条离线消息，多个用户共享同一份消息内容
+    void add(const vector<int> &user_ids, const string &msg);
+
+    // 写入屏障：等待调用之前放入队列的消息全部处理完成，超时或等待期间有消息写入失败被丢弃时返回false
+    // 数据库不可用时消息留在队列中等待重试，写入屏障超时返回false
+    // 用户登录读取离线消息之前调用，保证登录前刚存储的离线消息能被读到
+    bool flush();
+
+    // 队列中等待写入的消息数量
+    size_t pending();
+
+    // 成功写入数据库的消息数量
+    uint64_t written();
+
+    // 写入失败被丢弃的消息数量
+    uint64_t dropped();
+
+private:
+    OfflineMsgBatcher();
+    ~OfflineMsgBatcher();
+
+    // 一条待写入的离线消息
+    struct Row
+    {
+        int user_id;
+        shared_ptr<const string> msg;
+    };
+
+    // 写入线程的主循环
+    void writeTask();
+
+    // 写入rows[begin, end)，整批失败时二分后分别写入，只丢弃无法写入的行，返回丢弃的行数
+    // 取不到连接的行放入retry，由写入线程放回队列稍后重新写入
+    size_t writeRange(const vector<Row> &rows, size_t begin, size_t end, vector<Row> &retry);
+
+    // 在一个事务中写入rows[begin, end)，取不到连接时把noConnection置为true
+    bool write(const vector<Row> &rows, size_t begin, size_t end, bool &noConnection);
+
+    // 一条INSERT语句最多携带的行数
+    static const size_t kMaxRowsPerStatement = 64;
+    // 一个事务最多写入的行数，队列达到这个数量时立即写入
+    static const size_t kMaxBatchSize = 1024;
+    // 最早的消息最多等待的时间
+    static const chrono::milliseconds kFlushInterval;
+    // 写入屏障最多等待的时间
+    static const chrono::milliseconds kFlushTimeout;
+    // 取不到连接时重新写入的间隔
+    static const chrono::milliseconds kRetryInterval;
+
+    mutex _queueMutex;
+    // 通知写入线程有消息需要写入
+    condition_variable _writeCv;
+    // 通知等待写入屏障的线程
+    condition_variable _flushCv;
+
+    vector<Row> _queue;
+    // 最早一条消息放入队列的时间
+    chrono::steady_clock::time_point _firstTime;
+    // 已经放入队列和已经处理完成（写入或丢弃）的消息数量，写入屏障据此判断之前的消息是否已经处理
+    uint64_t _enqueued;
+    uint64_t _processed;
+    // 成功写入和写入失败被丢弃的消息数量
+    uint64_t _written;
+    uint64_t _dropped;
+    // 等待写入屏障的线程数量，有线程等待时不等待时间阈值
+    int _flushWaiters;
+    bool _quit;
+
+    thread _writeThread;
+};
+
+#endif
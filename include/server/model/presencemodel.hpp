@@ -0,0 +1,62 @@
+#ifndef PRESENCEMODEL_H
+#define PRESENCEMODEL_H
+
+#include "redis.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+// 用户在线状态的操作类，在线状态保存在redis中，不再读写User表的state字段
+// chat:presence hash表记录用户id到所在节点id的映射，每个节点再用一个set记录自己节点上的用户
+// 每个节点在chat:leases hash表中持有一个带到期时间的租约，节点定期续约；节点崩溃后租约到期，查询时它上面的用户视为离线，
+// 到期节点的在线记录由各节点定期调用reapExpiredNodes删除，查询路径上不做写操作
+// 所有状态变化都由lua脚本在redis中原子完成，脚本访问的key都通过KEYS传入
+class PresenceModel
+{
+public:
+    // 上线的结果
+    enum OnlineResult
+    {
+        ONLINE_OK,      // 上线成功
+        ONLINE_ALREADY, // 用户已经在存活的节点上线
+        ONLINE_ERROR,   // redis不可用或超时，用户的在线状态保持不变
+    };
+
+    PresenceModel(Redis *redis);
+
+    // 用户在node上线，用户已经在其它存活的节点（包括本节点）上线时返回ONLINE_ALREADY
+    OnlineResult setOnline(int user_id, const string &node);
+
+    // 用户从node下线，仅当用户记录的节点是node时才删除，避免删掉用户在其它节点上的新登录
+    void setOffline(int user_id, const string &node);
+
+    // 批量查询用户所在的节点，返回值与ids一一对应，不在线的用户为空字符串
+    // 用户所在节点和节点租约在同一个只读脚本中检查，所有脚本在同一个连接上流水线发送，只需一次往返
+    vector<string> query(const vector<int> &ids);
+
+    // 续约node的租约，需要每隔kLeaseRefreshInterval秒调用一次
+    void refreshLease(const string &node);
+
+    // 删除租约已经到期的节点上所有用户的在线记录，与续约一起定期调用，不等待结果
+    void reapExpiredNodes();
+
+    // 删除node上所有用户的在线记录和node的租约，服务器启动和退出时调用
+    bool clearNode(const string &node);
+
+    // 续约间隔，单位秒
+    static constexpr double kLeaseRefreshInterval = 10.0;
+
+private:
+    // 租约的有效时间，单位毫秒，至少覆盖两次续约
+    static const int kLeaseTTL = 30000;
+    // 一条查询脚本最多携带的用户数量，超过则拆分成多条命令流水线发送
+    static const size_t kMaxBatchSize = 1000;
+
+    // 一次上线请求的状态，在调用线程和redis线程之间共享
+    struct OnlineTask;
+
+    Redis *_redis;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef USERCACHE_H
+#define USERCACHE_H
+
+#include "user.hpp"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+// User表的进程内缓存，按用户id分片，每个分片是一个带过期时间的LRU链表
+// UserModel::query先查缓存，未命中再查数据库；修改User表的方法调用changed，删除本节点的缓存并通过redis通知其它节点删除
+// 只缓存id、name、password，在线状态以redis中的在线表为准，不进入缓存
+class UserCache
+{
+public:
+    // 获取单例对象的接口函数
+    static UserCache *instance();
+
+    // 查询缓存，命中返回true
+    bool get(int id, User &user);
+
+    // 用户所在分片的失效代数，查询数据库之前读取，写回缓存时传给put
+    uint64_t generation(int id);
+
+    // 写入缓存，超过容量时淘汰最久未使用的数据
+    // 读取generation之后分片中有数据被删除时放弃写入，避免查到的旧数据覆盖更新的失效
+    void put(User user, uint64_t generation);
+
+    // 删除本节点缓存中的用户
+    void invalidate(int id);
+
+    // 用户数据被本节点修改：删除本节点的缓存，并通知其它节点删除
+    void changed(int id);
+
+    // 设置通知其它节点删除缓存的回调，由业务层通过redis通道广播
+    void setInvalidateNotifier(std::function<void(int)> notifier);
+
+    // 缓存命中次数
+    uint64_t hits() const { return _hits; }
+
+    // 缓存未命中次数
+    uint64_t misses() const { return _misses; }
+
+    // 缓存中的用户数量
+    size_t size();
+
+private:
+    UserCache();
+
+    using Clock = std::chrono::steady_clock;
+
+    // 缓存项：用户数据和过期时间
+    struct Entry
+    {
+        User user;
+        Clock::time_point expire;
+    };
+
+    // 一个分片，链表头部是最近使用的数据
+    struct Shard
+    {
+        std::mutex mutex;
+        std::list<Entry> lru;
+        std::unordered_map<int, std::list<Entry>::iterator> index;
+        uint64_t generation = 0; // 每次invalidate加一
+    };
+
+    Shard &getShard(int id) { return _shards[static_cast<size_t>(id) % kShardCount]; }
+
+    static const size_t kShardCount = 16;
+    // 每个分片最多缓存的用户数量
+    static const size_t kShardCapacity = 8192;
+    // 缓存数据的有效时间
+    static const std::chrono::seconds kTTL;
+
+    Shard _shards[kShardCount];
+    std::function<void(int)> _notifier;
+    std::atomic<uint64_t> _hits;
+    std::atomic<uint64_t> _misses;
+};
+
+#endif
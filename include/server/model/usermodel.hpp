@@ -10,14 +10,8 @@ public:
     // User表的增加方法
     bool insert(User &user);
 
-    // 根据用户号码查询用户信息
+    // 根据用户号码查询用户信息，返回的用户不带在线状态，在线状态以PresenceModel为准
     User query(int id);
-
-    // 更新用户的状态信息
-    bool updateState(User user);
-
-    // 重置用户的状态信息
-    void resetState();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,55 @@
+#ifndef ONLINEUSERREGISTRY_H
+#define ONLINEUSERREGISTRY_H
+
+#include <muduo/net/TcpConnection.h>
+#include <unordered_map>
+#include <vector>
+#include <utility>
+#include <mutex>
+
+using namespace muduo::net;
+
+// 在线用户的通信连接表
+// 按用户id分成多个分片，每个分片有独立的互斥锁，不同用户的查找、登录、下线不再竞争同一把锁
+class OnlineUserRegistry
+{
+public:
+    // 查找用户的连接，用户不在本服务器上返回nullptr
+    TcpConnectionPtr find(int id);
+
+    // 记录用户的连接，已存在则覆盖
+    void insert(int id, const TcpConnectionPtr &conn);
+
+    // 删除用户的连接，返回用户是否存在
+    bool remove(int id);
+
+    // 仅当用户当前记录的连接是conn时才删除，返回是否删除
+    bool remove(int id, const TcpConnectionPtr &conn);
+
+    // 批量查找，每个分片只加一次锁
+    // found返回在本服务器上的用户及其连接，missing返回不在本服务器上的用户id
+    void findMany(const std::vector<int> &ids,
+                  std::vector<std::pair<int, TcpConnectionPtr>> &found,
+                  std::vector<int> &missing);
+
+    // 在线用户总数
+    size_t size();
+
+private:
+    // 分片数量，取2的幂方便用位运算定位分片
+    static const size_t kShardCount = 64;
+
+    // 每个分片独占一个缓存行，避免相邻分片的锁产生伪共享
+    struct alignas(64) Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<int, TcpConnectionPtr> conns;
+    };
+
+    // 根据用户id定位分片
+    static size_t shardIndex(int id) { return static_cast<size_t>(id) & (kShardCount - 1); }
+
+    Shard _shards[kShardCount];
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef ASYNCREDIS_H
+#define ASYNCREDIS_H
+
+#include <hiredis/async.h>
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/Channel.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace muduo;
+using namespace muduo::net;
+
+// 基于redisAsyncContext的异步redis客户端，由muduo的EventLoop和Channel驱动
+// 所有hiredis操作都在_loop所在的线程中执行，其它线程发起的命令通过runInLoop投递过来
+// 多条命令在同一个连接上流水线发送，不需要等待前一条命令的响应
+class AsyncRedis
+{
+public:
+    // 命令完成回调，在_loop线程中执行，失败时reply为nullptr
+    using CommandCallback = std::function<void(redisReply *reply)>;
+    // 发布完成回调，在_loop线程中执行，receivers为收到消息的订阅者数量，失败时为0
+    using PublishCallback = std::function<void(bool ok, long long receivers)>;
+
+    AsyncRedis(EventLoop *loop, const std::string &ip, int port);
+
+    // 必须在_loop线程中析构
+    ~AsyncRedis();
+
+    // 发起连接，连接断开后自动重连
+    void connect();
+
+    // 是否已经连接到redis服务器
+    bool connected() const { return _connected; }
+
+    // 驱动该客户端的事件循环
+    EventLoop *getLoop() const { return _loop; }
+
+    // 发送任意命令，可在任意线程调用
+    void command(std::vector<std::string> argv, CommandCallback cb);
+
+    // 向通道发布消息，可在任意线程调用
+    void publish(const std::string &channel, const std::string &message, PublishCallback done = nullptr);
+
+private:
+    // 一条等待发送的命令
+    struct Command
+    {
+        std::vector<std::string> argv;
+        CommandCallback cb;
+    };
+
+    // 在_loop线程中发送命令，未连接时先暂存
+    void commandInLoop(Command cmd);
+
+    // 把命令写入hiredis的发送缓冲区
+    void sendCommand(Command &cmd);
+
+    // 连接断开或连接失败后，延时重连
+    void scheduleReconnect();
+
+    // hiredis上下文被释放后，清理对应的Channel
+    void cleanupChannel();
+
+    void handleRead(Timestamp receiveTime);
+    void handleWrite();
+
+    // hiredis回调，通过ac->data或privdata找到对应的AsyncRedis对象
+    static AsyncRedis *getRedis(const redisAsyncContext *ac);
+    static void connectCallback(const redisAsyncContext *ac, int status);
+    static void disconnectCallback(const redisAsyncContext *ac, int status);
+    static void commandCallback(redisAsyncContext *ac, void *reply, void *privdata);
+
+    // hiredis事件钩子，把读写事件的注册转换成Channel上的操作
+    static void addRead(void *privdata);
+    static void delRead(void *privdata);
+    static void addWrite(void *privdata);
+    static void delWrite(void *privdata);
+    static void cleanup(void *privdata);
+
+    // 断线期间最多暂存的命令数量，超过的命令直接按失败处理
+    static const size_t kMaxPendingCommands = 100000;
+    // 重连间隔，单位秒
+    static constexpr double kReconnectInterval = 1.0;
+
+    EventLoop *_loop;
+    std::string _ip;
+    int _port;
+    redisAsyncContext *_context;
+    std::shared_ptr<Channel> _channel;
+    std::atomic_bool _connected;
+    bool _reconnecting;
+
+    // 断线期间暂存的命令，连接成功后按顺序发送
+    std::deque<Command> _pending;
+};
+
+#endif
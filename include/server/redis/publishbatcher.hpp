@@ -0,0 +1,44 @@
+#ifndef PUBLISHBATCHER_H
+#define PUBLISHBATCHER_H
+
+#include "asyncredis.hpp"
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 发布消息的批处理器
+// 各线程提交的发布请求先放入队列，每轮事件循环（或每个时间窗口）在redis线程中统一取出，
+// 一次性写入hiredis的发送缓冲区，所有PUBLISH命令流水线发送，只需要一次写操作和一个往返
+class PublishBatcher
+{
+public:
+    // flushDelay为攒批的时间窗口，单位秒，0表示在下一轮事件循环中立即发送
+    explicit PublishBatcher(AsyncRedis *redis, double flushDelay = 0.0);
+
+    // 提交一条发布请求，可在任意线程调用，done在发布完成后在redis线程中回调
+    void publish(std::string channel, std::string message, AsyncRedis::PublishCallback done = nullptr);
+
+    // 当前排队等待发送的发布请求数量
+    size_t pending();
+
+private:
+    // 一条等待发送的发布请求
+    struct Entry
+    {
+        std::string channel;
+        std::string message;
+        AsyncRedis::PublishCallback done;
+    };
+
+    // 在redis线程中把队列中的所有发布请求一次性发送
+    void flush();
+
+    AsyncRedis *_redis;
+    double _flushDelay;
+
+    std::mutex _mutex;
+    std::vector<Entry> _entries; // 等待发送的发布请求
+    bool _flushScheduled;        // 是否已经安排了一次发送，避免每条请求都唤醒redis线程
+};
+
+#endif
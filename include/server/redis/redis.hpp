@@ -2,9 +2,16 @@
 #define REDIS_H
 
 #include <hiredis/hiredis.h>
+#include <muduo/net/EventLoopThread.h>
 #include <thread>
 #include <functional>
+#include <memory>
 #include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "asyncredis.hpp"
+#include "publishbatcher.hpp"
 using namespace std;
 
 class Redis
@@ -16,30 +23,44 @@ public:
     // 连接redis服务器
     bool connect();
 
-    // 向redis指定的通道channel发布消息
-    bool publish(int channel, string message);
+    // 向redis指定的通道channel发布消息，异步发送不阻塞调用线程，返回是否成功提交
+    // done在发布完成后在redis线程中回调，参数为是否成功和收到消息的订阅者数量
+    bool publish(const string &channel, const string &message, AsyncRedis::PublishCallback done = nullptr);
 
     // 向redis指定的通道subscribe订阅消息
-    bool subscribe(int channel);
+    bool subscribe(const string &channel);
 
     // 向redis指定的通道unsubscribe取消订阅消息
-    bool unsubscribe(int channel);
+    bool unsubscribe(const string &channel);
+
+    // 通过异步上下文发送任意命令，回调在redis线程中执行，失败时reply为nullptr，返回是否成功提交
+    bool command(vector<string> argv, AsyncRedis::CommandCallback cb);
 
     // 在独立线程中接收订阅通道中的消息，响应消息
     void observer_channel_message();
 
-    // 初始化向业务层上报通道消息的回调对象
-    void init_notify_handler(function<void(int, string)> fn);
+    // 初始化向业务层上报通道消息的回调对象，参数为通道名和消息内容
+    void init_notify_handler(function<void(string, string)> fn);
 
 private:
-    // hiredis同步上下文对象，负责publish消息，发布消息
-    redisContext *_publish_context;
+    // 驱动异步redis客户端的独立事件循环线程
+    unique_ptr<EventLoopThread> _command_loop_thread;
+
+    // hiredis异步上下文对象，负责publish消息和其它命令，在_command_loop_thread中运行
+    AsyncRedis *_command_context;
+
+    // 发布消息的批处理器，把同一轮事件循环中的发布请求合并成一次流水线发送
+    unique_ptr<PublishBatcher> _publish_batcher;
+
+    // 发布成功和失败的消息数量，用于采样日志
+    atomic<uint64_t> _published;
+    atomic<uint64_t> _publish_failed;
 
     // hiredis同步上下文对象，负责subscribe消息，订阅消息
     redisContext *_subscribe_context;
 
     // 回调操作，收到订阅的消息，给service层上报
-    function<void(int, string)> _notify_message_handler;
+    function<void(string, string)> _notify_message_handler;
 
     // 新增：保护 _subscribe_context 的互斥锁
     mutex _subscribe_mutex;
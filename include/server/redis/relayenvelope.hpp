@@ -0,0 +1,96 @@
+#ifndef RELAYENVELOPE_H
+#define RELAYENVELOPE_H
+
+#include <arpa/inet.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// 跨服务器转发消息的信封，发布到目标服务器的节点通道上
+// 格式：4字节群组id + 4字节群组时间线序号 + 4字节接收者数量 + 每个接收者4字节用户id + 消息帧，整数均为网络字节序
+// 消息帧与发送给客户端的格式完全相同（4字节长度前缀 + JSON数据），由发布节点校验并封装
+// 接收节点需要的路由字段都在信封头部，不需要扫描或解析消息，取出消息帧直接写入接收者的连接
+// 一条信封可以携带同一服务器上的多个接收者，群聊时每个服务器只需要发布一次
+class RelayEnvelope
+{
+public:
+    // 消息帧长度前缀的字节数
+    static const size_t kFrameHeaderLen = 4;
+
+    // 信封头部的字节数：群组id、序号和接收者数量
+    static const size_t kHeaderLen = 12;
+
+    // 封装信封，payload是已经校验过的JSON消息
+    // seq大于0时消息已经写入群组groupId的时间线，一对一聊天和没有写入时间线的群消息两者都为0
+    static std::string encode(const std::vector<int> &targets, const std::string &payload, int groupId = 0, int seq = 0)
+    {
+        std::string data;
+        data.reserve(kHeaderLen + 4 * targets.size() + kFrameHeaderLen + payload.size());
+        appendInt32(data, static_cast<uint32_t>(groupId));
+        appendInt32(data, static_cast<uint32_t>(seq));
+        appendInt32(data, static_cast<uint32_t>(targets.size()));
+        for (int id : targets)
+        {
+            appendInt32(data, static_cast<uint32_t>(id));
+        }
+        appendInt32(data, static_cast<uint32_t>(payload.size()));
+        data.append(payload);
+        return data;
+    }
+
+    // 解析信封，frameOffset返回消息帧在data中的起始位置，格式错误返回false
+    static bool decode(const std::string &data, std::vector<int> &targets, int &groupId, int &seq, size_t &frameOffset)
+    {
+        if (data.size() < kHeaderLen)
+        {
+            return false;
+        }
+
+        // 群组id和序号不会是负数，只有写入了时间线的消息才有序号
+        groupId = static_cast<int>(readInt32(data.data()));
+        seq = static_cast<int>(readInt32(data.data() + 4));
+        if (groupId < 0 || seq < 0 || (seq > 0 && groupId == 0))
+        {
+            return false;
+        }
+
+        uint32_t count = readInt32(data.data() + 8);
+        if (count > (data.size() - kHeaderLen) / 4)
+        {
+            return false;
+        }
+
+        // 消息帧的长度前缀必须与剩余的数据长度一致
+        frameOffset = kHeaderLen + 4 * static_cast<size_t>(count);
+        if (data.size() - frameOffset < kFrameHeaderLen ||
+            readInt32(data.data() + frameOffset) != data.size() - frameOffset - kFrameHeaderLen)
+        {
+            return false;
+        }
+
+        targets.clear();
+        targets.reserve(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            targets.push_back(static_cast<int>(readInt32(data.data() + kHeaderLen + 4 * i)));
+        }
+        return true;
+    }
+
+private:
+    static void appendInt32(std::string &data, uint32_t value)
+    {
+        uint32_t be = htonl(value);
+        data.append(reinterpret_cast<const char *>(&be), 4);
+    }
+
+    static uint32_t readInt32(const char *p)
+    {
+        uint32_t be;
+        memcpy(&be, p, 4);
+        return ntohl(be);
+    }
+};
+
+#endif
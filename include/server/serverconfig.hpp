@@ -0,0 +1,42 @@
+#ifndef SERVERCONFIG_H
+#define SERVERCONFIG_H
+
+#include <cstdint>
+#include <string>
+
+// 服务器启动配置，依次取默认值、配置文件、命令行参数，后面的覆盖前面的
+// 配置文件每行一个 key = value，#开头的行是注释，key与命令行的长选项同名，下划线和连字符等价
+struct ServerConfig
+{
+    std::string ip;
+    uint16_t port = 0;
+    // 节点在集群中的id，为空时使用主机名:监听地址:端口，打开reusePort时必须配置
+    std::string nodeId;
+    // IO线程数量，-1表示使用服务器的默认值
+    int ioThreads = -1;
+    // 业务线程数量，-1表示使用服务器的默认值，0表示业务直接在IO线程中执行
+    int workerThreads = -1;
+    // 为true时每个IO线程各自用SO_REUSEPORT监听同一端口，由内核分配新连接，不再由单个线程accept
+    bool reusePort = false;
+    // 为true时把IO线程依次绑定到各个CPU上
+    bool cpuAffinity = false;
+    // 发给同一连接的消息帧最多等待的毫秒数，0表示只合并同一轮事件循环中的消息帧
+    double corkDelayMs = 0;
+    // 是否校验跨服务器转发的消息内容，关闭时只校验信封结构和消息帧长度，仅用于调试
+    bool relayValidate = false;
+
+    // 解析命令行参数，-c指定的配置文件先于其它选项读取，失败时在err中返回原因
+    bool parse(int argc, char **argv, std::string &err);
+
+    // 读取配置文件，失败时在err中返回原因
+    bool load(const std::string &path, std::string &err);
+
+    // 打印命令行用法
+    static void usage(const char *prog);
+
+private:
+    // 设置一项配置，key使用长选项的名字
+    bool set(const std::string &key, const std::string &value, std::string &err);
+};
+
+#endif
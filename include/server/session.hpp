@@ -0,0 +1,173 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <muduo/net/Buffer.h>
+#include <muduo/net/TcpConnection.h>
+#include <boost/any.hpp>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace muduo::net;
+
+// 已添加4字节长度前缀的完整消息帧，创建后只读，群发时所有接收者共享同一份数据
+using FramePtr = std::shared_ptr<const std::string>;
+
+// 连接会话信息，建立连接时保存到TcpConnection的context中，记录该连接登录的用户和会话状态
+// 断开连接时直接从context中取出用户id，不需要遍历在线用户表
+struct Session
+{
+    enum State
+    {
+        kConnected, // 已连接，未登录或已注销
+        kLoggedIn,  // 已登录
+    };
+
+    // 连接建立时分配的序号，用于选择处理该连接业务的工作线程，连接生命周期内不变
+    const size_t workerKey;
+
+    explicit Session(size_t key = 0) : workerKey(key) {}
+
+    std::atomic<int> userId{-1};
+    std::atomic<int> state{kConnected};
+    // 登录时协商的编码方式，为true时发给该连接的聊天消息使用BinaryCodec编码
+    std::atomic<bool> binary{false};
+
+    // 发送合并的状态，只在连接所属的IO线程中访问
+    // 一轮事件循环中发给该连接的消息帧先放入pendingFrames，flushScheduled保证只安排一次发送
+    std::vector<FramePtr> pendingFrames;
+    // pendingFrames中群组时间线消息的群组id和序号，发送时记录到groupTimelines
+    std::vector<std::pair<int, int>> pendingSeqs;
+    size_t pendingBytes = 0;
+    bool flushScheduled = false;
+    // 合并多个消息帧的缓冲区，发送后保留容量重复使用
+    Buffer corkBuffer;
+
+    // 慢消费者状态，只在连接所属的IO线程中访问
+    // 输出缓冲区超过高水位后congested为true，期间发给该连接的聊天消息转存为离线消息
+    // 每次进入拥塞状态congestion加一，宽限期定时器据此判断是否还是同一次拥塞
+    bool congested = false;
+    unsigned congestion = 0;
+    // 有聊天消息转存为离线消息后resyncing为true，解除拥塞后聊天消息继续转存，保持与已转存消息之间的顺序，
+    // 直到客户端完成一次离线消息同步并且同步期间没有新的转存；divertedFrames是累计转存的消息数量
+    // 两者在IO线程中修改，在业务线程中读取
+    std::atomic<bool> resyncing{false};
+    std::atomic<unsigned> divertedFrames{0};
+
+    // 用户在一个群组时间线上的同步和送达状态
+    struct GroupTimeline
+    {
+        bool tracked = false; // 是否已经记录了同步范围
+        int acked = 0;        // 客户端已经确认、已经写入数据库的已读位置
+        int bound = 0;        // 登录或加入群组时的最新序号，(acked, bound]通过离线消息同步分页读取
+        int lastLive = 0;     // 实时写入该连接（或转存为个人离线消息）的最大序号
+        int liveCount = 0;    // 实时送达的序号大于bound的消息数量
+    };
+
+    // 群组id -> 时间线状态，同步和确认在业务线程中访问，送达在IO线程中记录
+    std::mutex groupMutex;
+    std::unordered_map<int, GroupTimeline> groupTimelines;
+
+    // 记录群组的同步范围：已读位置cursor和当前的最新序号latest
+    void trackGroup(int groupId, int cursor, int latest)
+    {
+        std::lock_guard<std::mutex> lock(groupMutex);
+        GroupTimeline &timeline = groupTimelines[groupId];
+        timeline.tracked = true;
+        timeline.acked = cursor;
+        timeline.bound = latest > cursor ? latest : cursor;
+    }
+
+    // 记录实时送达的时间线消息
+    void recordDelivered(int groupId, int seq)
+    {
+        std::lock_guard<std::mutex> lock(groupMutex);
+        GroupTimeline &timeline = groupTimelines[groupId];
+        if (!timeline.tracked || seq > timeline.bound)
+        {
+            ++timeline.liveCount;
+        }
+        if (seq > timeline.lastLive)
+        {
+            timeline.lastLive = seq;
+        }
+    }
+
+    // 客户端确认同步到了seq，不超过同步范围，已读位置前移时返回新的位置，否则返回0
+    int ackGroup(int groupId, int seq)
+    {
+        std::lock_guard<std::mutex> lock(groupMutex);
+        auto it = groupTimelines.find(groupId);
+        if (it == groupTimelines.end() || !it->second.tracked)
+        {
+            return 0;
+        }
+        GroupTimeline &timeline = it->second;
+        seq = seq < timeline.bound ? seq : timeline.bound;
+        if (seq <= timeline.acked)
+        {
+            return 0;
+        }
+        timeline.acked = seq;
+        return seq;
+    }
+
+    // 还没有同步完的群组：群组id，已确认的位置和同步范围的上限
+    std::vector<std::pair<int, std::pair<int, int>>> unsyncedGroups()
+    {
+        std::lock_guard<std::mutex> lock(groupMutex);
+        std::vector<std::pair<int, std::pair<int, int>>> groups;
+        for (auto &group : groupTimelines)
+        {
+            if (group.second.tracked && group.second.acked < group.second.bound)
+            {
+                groups.emplace_back(group.first, std::make_pair(group.second.acked, group.second.bound));
+            }
+        }
+        std::sort(groups.begin(), groups.end());
+        return groups;
+    }
+
+    // 取出并清空所有群组的时间线状态
+    std::unordered_map<int, GroupTimeline> takeGroupTimelines()
+    {
+        std::lock_guard<std::mutex> lock(groupMutex);
+        std::unordered_map<int, GroupTimeline> timelines;
+        timelines.swap(groupTimelines);
+        return timelines;
+    }
+
+    // 登录成功，记录用户id
+    void login(int id)
+    {
+        userId = id;
+        state = kLoggedIn;
+    }
+
+    // 下线，返回下线前登录的用户id，未登录或重复调用返回-1，保证注销后再断开连接不会重复处理
+    int logout()
+    {
+        int expected = kLoggedIn;
+        if (!state.compare_exchange_strong(expected, kConnected))
+        {
+            return -1;
+        }
+        return userId.exchange(-1);
+    }
+};
+
+using SessionPtr = std::shared_ptr<Session>;
+
+// 获取连接的会话信息，没有会话返回nullptr
+inline SessionPtr getSession(const TcpConnectionPtr &conn)
+{
+    const SessionPtr *session = boost::any_cast<SessionPtr>(&conn->getContext());
+    return session != nullptr ? *session : SessionPtr();
+}
+
+#endif
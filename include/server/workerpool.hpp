@@ -0,0 +1,47 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <muduo/base/ThreadPool.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// 业务线程池，把会阻塞的数据库、redis操作从muduo的IO线程中移出去执行
+// 由多个单线程的ThreadPool组成，相同key的任务总是投递到同一个工作线程，保证同一连接上的消息按到达顺序处理
+class WorkerPool
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkerPool(const std::string &name = "WorkerPool");
+    ~WorkerPool();
+
+    // 设置工作线程数量，必须在start之前调用，0表示不启用线程池，任务直接在调用线程中执行
+    void setThreadNum(int numThreads);
+
+    // 启动所有工作线程
+    void start();
+
+    // 停止所有工作线程
+    void stop();
+
+    // 根据key选择工作线程，投递任务
+    void run(size_t key, Task task);
+
+    // 工作线程数量
+    int threadNum() const { return _numThreads; }
+
+    // 所有工作线程排队等待执行的任务总数
+    size_t queueSize() const;
+
+    // 排队任务最多的工作线程的队列长度
+    size_t maxQueueSize() const;
+
+private:
+    std::string _name;
+    int _numThreads;
+    std::vector<std::unique_ptr<muduo::ThreadPool>> _workers;
+};
+
+#endif
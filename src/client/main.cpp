@@ -11,11 +11,13 @@
 #include <algorithm>
 #include <semaphore.h>
 #include <atomic>
+#include <mutex>
 
 #include "json.hpp"
 using json = nlohmann::json;
 
 #include "public.hpp"
+#include "binarycodec.hpp"
 #include "user.hpp"
 #include "group.hpp"
 
@@ -33,6 +35,15 @@ bool isMainMenuRunning = false;
 sem_t rwsem;
 // 记录登录状态
 atomic_bool _isLoginSuccess{false};
+// 登录时是否请求使用二进制编码的聊天消息，启动参数指定json时使用JSON，便于调试
+bool _useBinary = true;
+// 服务器是否同意使用二进制编码
+atomic_bool _binaryNegotiated{false};
+// 是否正在同步离线消息，同步期间收到服务器的离线消息通知时记录在_offlineSyncPending中，本次同步结束后再同步一次
+atomic_bool _offlineSyncing{false};
+atomic_bool _offlineSyncPending{false};
+// 主线程和接收线程都会发送消息，一条消息必须完整发送后才能发送下一条，否则两条消息的字节会交错
+mutex _sendMutex;
 
 // 接受线程
 void readTaskHandler(int client_fd);
@@ -42,13 +53,17 @@ string getCurrentTime();
 void mainMenu(int);
 // 显示当前登录成功用户的基本信息
 void showCurrentUserData();
+// 发送完整消息：添加4字节长度前缀，与服务器的解码格式保持一致
+ssize_t sendMsg(int client_fd, const string &msg);
+// 序列化要发送的消息，协商了二进制编码时聊天消息使用二进制编码
+string encodeMsg(const json &js);
 
 // 聊天客户端程序实现，main线程用作发送线程，子线程用作接收线程
 int main(int argc, char **argv)
 {
     if (argc < 3)
     {
-        cerr << "Command invalid! Example:./ChatClient 127.0.0.1 6000" << endl;
+        cerr << "Command invalid! Example:./ChatClient 127.0.0.1 6000 [json]" << endl;
         exit(-1);
     }
 
@@ -56,6 +71,12 @@ int main(int argc, char **argv)
     char *ip = argv[1];
     uint16_t port = atoi(argv[2]);
 
+    // 可选参数json：聊天消息使用JSON编码
+    if (argc > 3 && strcmp(argv[3], "json") == 0)
+    {
+        _useBinary = false;
+    }
+
     // 创建client端的socket
     int client_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (client_fd == -1)
@@ -117,11 +138,13 @@ int main(int argc, char **argv)
             js["msgid"] = LOGIN_MSG;
             js["id"] = id;
             js["password"] = pwd;
+            js["version"] = PROTOCOL_V2; // 登录响应使用嵌套的JSON对象，不需要逐个元素再解析
+            js["binary"] = _useBinary;   // 请求聊天消息使用二进制编码
             string request = js.dump();
 
             _isLoginSuccess = false;
 
-            ssize_t len = send(client_fd, request.c_str(), strlen(request.c_str()) + 1, 0);
+            ssize_t len = sendMsg(client_fd, request);
             if (len == -1)
             {
                 cerr << "Failed to send login msg:" << request << endl;
@@ -132,6 +155,13 @@ int main(int argc, char **argv)
 
             if (_isLoginSuccess)
             {
+                // 从头开始分页同步离线消息，后续的页由接收线程请求
+                _offlineSyncing = true;
+                json sync_js;
+                sync_js["msgid"] = OFFLINE_SYNC_MSG;
+                sync_js["cursor"] = 0;
+                sendMsg(client_fd, sync_js.dump());
+
                 // 进入聊天主菜单页面
                 isMainMenuRunning = true;
                 mainMenu(client_fd);
@@ -153,7 +183,7 @@ int main(int argc, char **argv)
             js["password"] = pwd;
             string request = js.dump();
 
-            ssize_t len = send(client_fd, request.c_str(), strlen(request.c_str()) + 1, 0);
+            ssize_t len = sendMsg(client_fd, request);
             if (len == -1)
             {
                 cerr << "Failed to send reg msg!" << endl;
@@ -175,6 +205,81 @@ int main(int argc, char **argv)
     return 0;
 }
 
+// 显示一条离线消息，个人聊天信息或者群组消息
+void showOfflineMsg(const string &str)
+{
+    json js = json::parse(str);
+    // time + [id] + name + "said:" + xxx
+    if (js["msgid"].get<int>() == ONE_CHAT_MSG)
+    {
+        cout << js["time"].get<string>() << " [" << js["id"] << "] " << js["name"].get<string>()
+             << " said:" << js["msg"].get<string>() << endl;
+    }
+    else
+    {
+        cout << "群消息[" << js["group_id"] << "]: " << js["time"].get<string>() << " [" << js["id"] << "] " << js["name"].get<string>()
+             << " said:" << js["msg"].get<string>() << endl;
+    }
+}
+
+// 处理离线消息同步的响应：显示这一页离线消息，还有更多时请求下一页，否则确认已经收到
+void doOfflineSyncResponse(int client_fd, json &response_js)
+{
+    // 服务器暂时无法读取离线消息，本页之前的确认已经生效，稍后从头重新同步
+    if (response_js.value("errno", 0) != 0)
+    {
+        std::thread([client_fd]()
+                    {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            json js;
+            js["msgid"] = OFFLINE_SYNC_MSG;
+            js["cursor"] = 0;
+            sendMsg(client_fd, js.dump()); })
+            .detach();
+        return;
+    }
+
+    vector<string> vec = response_js["msgs"];
+    for (string &str : vec)
+    {
+        showOfflineMsg(str);
+    }
+
+    // 请求下一页的同时确认本页，服务器收到确认后才删除本页的个人离线消息、前移群组的已读位置
+    // groups是本页群消息同步到的位置，原样带回；最后一页为空时不需要确认
+    // 同步期间收到过离线消息通知时，最后一页也请求下一页，从确认的位置继续同步
+    bool more = response_js["more"].get<bool>() || _offlineSyncPending.exchange(false);
+    _offlineSyncing = more;
+    bool hasGroups = response_js.contains("groups");
+    if (more || !vec.empty() || hasGroups)
+    {
+        json js;
+        js["msgid"] = more ? OFFLINE_SYNC_MSG : OFFLINE_ACK_MSG;
+        js["cursor"] = response_js["cursor"].get<int>();
+        if (hasGroups)
+        {
+            js["groups"] = response_js["groups"];
+        }
+        sendMsg(client_fd, js.dump());
+    }
+}
+
+// 处理服务器的离线消息通知：没有在同步时从头同步，正在同步时记录下来，本次同步的最后一页之后继续同步
+void doOfflineNotify(int client_fd)
+{
+    if (_offlineSyncing)
+    {
+        _offlineSyncPending = true;
+        return;
+    }
+
+    _offlineSyncing = true;
+    json js;
+    js["msgid"] = OFFLINE_SYNC_MSG;
+    js["cursor"] = 0;
+    sendMsg(client_fd, js.dump());
+}
+
 // 处理登录响应的业务逻辑
 void doLoginResponse(json &response_js)
 {
@@ -186,20 +291,26 @@ void doLoginResponse(json &response_js)
     }
     else // 登录成功
     {
+        // 服务器同意使用二进制编码后，收发的聊天消息都使用二进制编码
+        _binaryNegotiated = response_js.contains("binary") && response_js["binary"].get<bool>();
+
         // 全局变量记录当前用户的id和name
         _currentUser.setId(response_js["id"].get<int>());
         _currentUser.setName(response_js["name"]);
 
+        // v2协议的好友、群组、群成员本身就是JSON对象，v1协议的是需要再解析一次的字符串
+        bool nested = response_js.contains("version") && response_js["version"].get<int>() >= PROTOCOL_V2;
+
         // 记录当前用户的好友列表信息
         if (response_js.contains("friends"))
         {
             // 初始化
             _currentUserFrientList.clear();
 
-            vector<string> vec = response_js["friends"];
-            for (string &str : vec)
+            for (const json &item : response_js["friends"])
             {
-                json js = json::parse(str);
+                json parsed;
+                const json &js = nested ? item : (parsed = json::parse(item.get<string>()));
                 User user;
                 user.setId(js["id"].get<int>());
                 user.setName(js["name"]);
@@ -214,21 +325,20 @@ void doLoginResponse(json &response_js)
             // 初始化
             _currentUserGroupList.clear();
 
-            vector<string> vec1 = response_js["groups"];
-            for (string &groupstr : vec1)
+            for (const json &groupItem : response_js["groups"])
             {
-                json group_js = json::parse(groupstr);
+                json groupParsed;
+                const json &group_js = nested ? groupItem : (groupParsed = json::parse(groupItem.get<string>()));
                 Group group;
                 group.setId(group_js["id"].get<int>());
                 group.setName(group_js["groupname"]);
                 group.setDesc(group_js["groupdesc"]);
 
-                // 错误！！！！！vector<string> vec2 = response_js["users"];
                 // response_js是顶层JSON，没有"users"字段，此处应从group_js中读取
-                vector<string> vec2 = group_js["users"];
-                for (string &userstr : vec2)
+                for (const json &userItem : group_js["users"])
                 {
-                    json user_js = json::parse(userstr);
+                    json userParsed;
+                    const json &user_js = nested ? userItem : (userParsed = json::parse(userItem.get<string>()));
                     GroupUser user;
                     user.setId(user_js["id"].get<int>());
                     user.setName(user_js["name"]);
@@ -241,29 +351,8 @@ void doLoginResponse(json &response_js)
             }
         }
 
-        // 显示当前登录用户的基本信息
+        // 显示当前登录用户的基本信息，离线消息登录成功后分页同步
         showCurrentUserData();
-
-        // 显示当前用户的离线消息、个人聊天信息或者群组消息
-        if (response_js.contains("offlinemsg"))
-        {
-            vector<string> vec = response_js["offlinemsg"];
-            for (string &str : vec)
-            {
-                json js = json::parse(str);
-                // time + [id] + name + "said:" + xxx
-                if (js["msgid"].get<int>() == ONE_CHAT_MSG)
-                {
-                    cout << js["time"].get<string>() << " [" << js["id"] << "] " << js["name"].get<string>()
-                         << " said:" << js["msg"].get<string>() << endl;
-                }
-                else
-                {
-                    cout << "群消息[" << js["group_id"] << "]: " << js["time"].get<string>() << " [" << js["id"] << "] " << js["name"].get<string>()
-                         << " said:" << js["msg"].get<string>() << endl;
-                }
-            }
-        }
         _isLoginSuccess = true;
     }
 }
@@ -303,13 +392,67 @@ json recvMsg(int client_fd)
     uint32_t len = ntohl(len_net); // 得到JSON数据的实际长度
 
     // 步骤2：按长度接收完整JSON数据（动态缓冲区，不依赖固定大小）
-    std::vector<char> buf(len);          // 动态缓冲区，刚好容纳完整数据
-    recv(client_fd, buf.data(), len, 0); // 阻塞收完整数据（循环收分包由OS底层处理）
+    std::vector<char> buf(len); // 动态缓冲区，刚好容纳完整数据
+    size_t received = 0;
+    while (received < len)
+    { // 一次recv可能只返回部分数据，循环接收直到收满len字节
+        ssize_t ret = recv(client_fd, buf.data() + received, len - received, 0);
+        if (ret <= 0)
+        {
+            throw std::runtime_error("接收消息数据失败");
+        }
+        received += ret;
+    }
 
-    // 步骤3：解析JSON（此时数据100%完整，无乱码）
+    // 步骤3：二进制编码的聊天消息转换成JSON，与JSON消息统一处理
+    if (BinaryCodec::isBinary(buf.data(), buf.size()))
+    {
+        BinaryCodec::ChatMessage chatMsg;
+        if (!BinaryCodec::decode(buf.data(), buf.size(), chatMsg))
+        {
+            throw std::runtime_error("解析二进制消息失败");
+        }
+        return BinaryCodec::toJson(chatMsg);
+    }
+
+    // 解析JSON（此时数据100%完整，无乱码）
     return json::parse(std::string(buf.begin(), buf.end()));
 }
 
+// 发送完整消息：添加4字节长度前缀，与服务器的解码格式保持一致
+ssize_t sendMsg(int client_fd, const string &msg)
+{
+    // 拼接“4字节长度前缀（网络字节序） + JSON数据”，一次发送，避免长度前缀和数据被拆成两个包
+    uint32_t len_net = htonl(msg.size());
+    string data(reinterpret_cast<char *>(&len_net), 4);
+    data += msg;
+
+    lock_guard<mutex> lock(_sendMutex);
+
+    size_t sent = 0;
+    while (sent < data.size())
+    { // send可能只发送部分数据，循环发送直到全部写入
+        ssize_t ret = send(client_fd, data.data() + sent, data.size() - sent, 0);
+        if (ret == -1)
+        {
+            return -1;
+        }
+        sent += ret;
+    }
+    return sent;
+}
+
+// 序列化要发送的消息，协商了二进制编码时聊天消息使用二进制编码
+string encodeMsg(const json &js)
+{
+    BinaryCodec::ChatMessage chatMsg;
+    if (_binaryNegotiated && BinaryCodec::fromJson(js, chatMsg))
+    {
+        return BinaryCodec::encode(chatMsg);
+    }
+    return js.dump();
+}
+
 // 接受线程
 void readTaskHandler(int client_fd)
 {
@@ -344,6 +487,18 @@ void readTaskHandler(int client_fd)
                 continue;
             }
 
+            if (msgtype == OFFLINE_SYNC_MSG_ACK)
+            {
+                doOfflineSyncResponse(client_fd, js); // 显示离线消息，请求下一页或确认收到
+                continue;
+            }
+
+            if (msgtype == OFFLINE_NOTIFY_MSG)
+            {
+                doOfflineNotify(client_fd); // 服务器有新的离线消息，开始同步或者在本次同步结束后再同步
+                continue;
+            }
+
             if (msgtype == REG_MSG_ACK)
             {
 
@@ -482,7 +637,7 @@ void addfriend(int client_fd, string str)
     js["friend_id"] = friend_id;
     string buffer = js.dump();
 
-    int len = send(client_fd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMsg(client_fd, buffer);
     if (len == -1)
     {
         cerr << "Failed to send addfriend msg -> " << buffer << endl;
@@ -512,12 +667,11 @@ void chat(int client_fd, string str)
         js["to"] = friend_id;
         js["msg"] = message;
         js["time"] = getCurrentTime();
-        string buffer = js.dump();
 
-        int len = send(client_fd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+        int len = sendMsg(client_fd, encodeMsg(js));
         if (len == -1)
         {
-            cerr << "Failed to send chat msg -> " << buffer << endl;
+            cerr << "Failed to send chat msg -> " << js.dump() << endl;
         }
     }
     else
@@ -547,7 +701,7 @@ void creategroup(int client_fd, string str)
     js["groupdesc"] = groupdesc;
     string buffer = js.dump();
 
-    int len = send(client_fd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMsg(client_fd, buffer);
     if (len == -1)
     {
         cerr << "Failed to send creategroup msg -> " << buffer << endl;
@@ -566,7 +720,7 @@ void addgroup(int client_fd, string str)
     js["group_id"] = group_id;
     string buffer = js.dump();
 
-    int len = send(client_fd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMsg(client_fd, buffer);
     if (len == -1)
     {
         cerr << "Failed to send addgroup msg -> " << buffer << endl;
@@ -593,12 +747,11 @@ void groupchat(int client_fd, string str)
     js["group_id"] = group_id;
     js["msg"] = message;
     js["time"] = getCurrentTime();
-    string buffer = js.dump();
 
-    int len = send(client_fd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMsg(client_fd, encodeMsg(js));
     if (len == -1)
     {
-        cerr << "Failed to send groupchat msg -> " << buffer << endl;
+        cerr << "Failed to send groupchat msg -> " << js.dump() << endl;
     }
 }
 
@@ -610,7 +763,7 @@ void loginout(int client_fd, string str)
     js["id"] = _currentUser.getId();
     string buffer = js.dump();
 
-    int len = send(client_fd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMsg(client_fd, buffer);
     if (len == -1)
     {
         cerr << "Failed to send loginout msg -> " << buffer << endl;
@@ -620,9 +773,12 @@ void loginout(int client_fd, string str)
         isMainMenuRunning = false;
     }
 
-    // 初始化
+    // 初始化，下次登录重新协商编码和同步离线消息
     _currentUserFrientList.clear();
     _currentUserGroupList.clear();
+    _binaryNegotiated = false;
+    _offlineSyncing = false;
+    _offlineSyncPending = false;
 }
 
 // 显示当前登录用户的基本信息
@@ -1,8 +1,20 @@
 #include "chatserver.hpp"
 #include "chatservice.hpp"
+#include "session.hpp"
+#include "offlinemsgbatcher.hpp"
 #include "json.hpp"
+#include "binarycodec.hpp"
+#include "jsonroutescanner.hpp"
+#include "public.hpp"
+#include <muduo/base/Logging.h>
+#include <algorithm>
 #include <functional>
 #include <string>
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 
 using namespace std::placeholders;
 using json = nlohmann::json;
@@ -10,31 +22,251 @@ using json = nlohmann::json;
 ChatServer::ChatServer(EventLoop *loop,
                        const InetAddress &listenAddr,
                        const string &nameArg)
-    : _server(loop, listenAddr, nameArg), _loop(loop)
+    : _listenAddr(listenAddr),
+      _name(nameArg),
+      _loop(loop),
+      _workerPool("ChatWorker"),
+      _backgroundPool("ChatBackground"),
+      _ioThreadNum(kDefaultIoThreadNum),
+      _reusePort(false),
+      _cpuAffinity(false),
+      _nextCpu(0),
+      _nextConnId(0)
 {
+    // 设置业务线程数量
+    _workerPool.setThreadNum(kDefaultWorkerThreadNum);
+    _backgroundPool.setThreadNum(1);
+}
+
+// 设置业务线程数量，在start之前调用
+void ChatServer::setWorkerThreadNum(int numThreads)
+{
+    _workerPool.setThreadNum(numThreads);
+}
+
+// 设置IO线程数量，在start之前调用
+void ChatServer::setIoThreadNum(int numThreads)
+{
+    _ioThreadNum = numThreads;
+}
+
+// 为true时每个IO线程各自用SO_REUSEPORT监听同一端口，由内核把新连接分配到各个线程，在start之前调用
+void ChatServer::setReusePort(bool on)
+{
+    _reusePort = on;
+}
+
+// 为true时把IO线程依次绑定到各个CPU上，在start之前调用
+void ChatServer::setCpuAffinity(bool on)
+{
+    _cpuAffinity = on;
+}
+
+// 设置本节点在集群中的id，在start之前调用，不设置时使用主机名和监听地址生成
+void ChatServer::setNodeId(const string &nodeId)
+{
+    _nodeId = nodeId;
+}
+
+// 生成默认的节点id：主机名:监听地址:端口，绑定0.0.0.0的多台主机、同一主机上监听不同地址的进程都不会重复
+// 不包含进程号，节点重启后id不变，启动时能清理上一次运行留下的在线记录，不必等待租约过期
+string ChatServer::defaultNodeId() const
+{
+    char host[256] = {0};
+    if (gethostname(host, sizeof(host) - 1) != 0)
+    {
+        strcpy(host, "localhost");
+    }
+    return string(host) + ":" + _listenAddr.toIpPort();
+}
+
+// 创建一个监听地址相同的TcpServer并注册回调
+TcpServer *ChatServer::addServer(EventLoop *loop, const string &name, TcpServer::Option option)
+{
+    _servers.emplace_back(new TcpServer(loop, _listenAddr, name, option));
+    TcpServer *server = _servers.back().get();
+
     // 注册链接回调
-    _server.setConnectionCallback(std::bind(&ChatServer::onConnection, this, _1));
+    server->setConnectionCallback(std::bind(&ChatServer::onConnection, this, _1));
 
     // 注册消息回调
-    _server.setMessageCallback(std::bind(&ChatServer::onMessage, this, _1, _2, _3));
+    server->setMessageCallback(std::bind(&ChatServer::onMessage, this, _1, _2, _3));
+    return server;
+}
 
-    // 设置线程数量
-    _server.setThreadNum(4);
+// 读取进程允许使用的CPU，受taskset、cgroup cpuset等限制时只是在线CPU的一部分，编号也不一定连续
+void ChatServer::loadAllowedCpus()
+{
+    _cpus.clear();
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    if (sched_getaffinity(0, sizeof(cpuset), &cpuset) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &cpuset))
+            {
+                _cpus.push_back(cpu);
+            }
+        }
+    }
+    else
+    {
+        LOG_ERROR << "sched_getaffinity failed:" << errno;
+    }
+}
+
+// IO线程启动时回调，按启动顺序把线程依次绑定到进程允许使用的CPU上
+void ChatServer::pinThread(EventLoop *loop)
+{
+    if (_cpus.empty())
+    {
+        return;
+    }
+    int cpu = _cpus[static_cast<size_t>(_nextCpu++) % _cpus.size()];
+
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+    if (ret != 0)
+    {
+        LOG_ERROR << "pin io thread to cpu " << cpu << " failed:" << ret;
+        return;
+    }
+    LOG_INFO << "pin io thread to cpu " << cpu;
 }
 
 // 启动服务
 void ChatServer::start()
 {
-    _server.start();
+    // 监听地址可能是0.0.0.0，不能作为节点id，没有配置节点id时生成一个不会重复的id
+    if (_nodeId.empty())
+    {
+        _nodeId = defaultNodeId();
+    }
+    LOG_INFO << "node id:" << _nodeId;
+
+    // 连接redis并订阅本节点的通道
+    ChatService::instance()->init(_nodeId);
+
+    _workerPool.start();
+    _backgroundPool.start();
+
+    EventLoopThreadPool::ThreadInitCallback initCallback;
+    if (_cpuAffinity)
+    {
+        // 在IO线程启动之前读取一次，之后只读
+        loadAllowedCpus();
+        initCallback = std::bind(&ChatServer::pinThread, this, _1);
+    }
+
+    if (_reusePort)
+    {
+        // 每个IO线程各自持有一个监听同一端口的socket，在自己的线程中accept，新连接留在该线程处理
+        // 主线程只负责定时任务，不再是所有新连接必经的accept线程
+        _listenerLoops.reset(new EventLoopThreadPool(_loop, _name + "-listener"));
+        _listenerLoops->setThreadNum(std::max(_ioThreadNum, 1));
+        _listenerLoops->start(initCallback);
+
+        std::vector<EventLoop *> loops = _listenerLoops->getAllLoops();
+        for (size_t i = 0; i < loops.size(); ++i)
+        {
+            TcpServer *server = addServer(loops[i], _name + "-" + std::to_string(i), TcpServer::kReusePort);
+            // TcpServer::start必须在它所属的事件循环中调用
+            loops[i]->runInLoop([server]()
+                                { server->start(); });
+        }
+    }
+    else
+    {
+        // 主线程accept，新连接轮流分配给IO线程
+        TcpServer *server = addServer(_loop, _name, TcpServer::kNoReusePort);
+        server->setThreadNum(_ioThreadNum);
+        server->setThreadInitCallback(initCallback);
+        server->start();
+    }
+
+    _loop->runEvery(kMetricsInterval, std::bind(&ChatServer::logMetrics, this));
+
+    // 定期续约本节点的在线状态租约，节点崩溃后租约过期，其它节点把它上面的用户视为离线
+    _loop->runEvery(PresenceModel::kLeaseRefreshInterval, []()
+                    { ChatService::instance()->refreshPresence(); });
+
+    // 定期删除所有成员都已经读过的群组时间线消息，删除语句较慢，放到后台线程中执行，不阻塞处理连接消息的工作线程
+    _loop->runEvery(ChatService::kGroupMessagePruneInterval, [this]()
+                    { _backgroundPool.run(0, []()
+                                          { ChatService::instance()->pruneGroupMessages(); }); });
+}
+
+// 把连接上的业务投递到业务线程池，同一连接的业务总是在同一个工作线程中按顺序执行
+void ChatServer::dispatch(const TcpConnectionPtr &conn, WorkerPool::Task task)
+{
+    // 连接建立时分配的序号依次递增，连接均匀分布到各个工作线程
+    // 不能直接用连接对象的地址：地址按16字节对齐，对2的幂个线程取模时都落在同一个线程上
+    SessionPtr session = getSession(conn);
+    size_t key = session ? session->workerKey : (reinterpret_cast<uintptr_t>(conn.get()) >> 4) * 0x9E3779B97F4A7C15ULL;
+    _workerPool.run(key, [conn, task]()
+                    {
+        try
+        {
+            task();
+        }
+        catch (const std::exception &e)
+        {
+            // 业务处理异常不能让工作线程退出
+            LOG_ERROR << "handle message from " << conn->name() << " failed:" << e.what();
+        } });
+}
+
+// 定期打印业务线程池的排队情况和缓存命中情况
+void ChatServer::logMetrics()
+{
+    LOG_INFO << "worker threads:" << _workerPool.threadNum()
+             << " queued tasks:" << _workerPool.queueSize()
+             << " max queue:" << _workerPool.maxQueueSize()
+             << " pending offline messages:" << OfflineMsgBatcher::instance()->pending()
+             << " written:" << OfflineMsgBatcher::instance()->written()
+             << " dropped:" << OfflineMsgBatcher::instance()->dropped();
+
+    ChatService *service = ChatService::instance();
+    LOG_INFO << "sent frames:" << service->sentFrames()
+             << " writes:" << service->sentWrites();
+    LOG_INFO << "congested connections:" << service->congestedConns()
+             << " max buffered bytes:" << service->takeMaxBufferedBytes()
+             << " diverted frames:" << service->divertedFrames()
+             << " slow consumer closes:" << service->slowConsumerCloses();
+
+    UserCache *userCache = UserCache::instance();
+    LOG_INFO << "user cache size:" << userCache->size()
+             << " hits:" << userCache->hits()
+             << " misses:" << userCache->misses();
+
+    GroupCache *groupCache = GroupCache::instance();
+    LOG_INFO << "group cache size:" << groupCache->size()
+             << " memory:" << groupCache->memoryUsage()
+             << " hits:" << groupCache->hits()
+             << " misses:" << groupCache->misses();
 }
 
 // 上报链接相关信息的回调函数
 void ChatServer::onConnection(const TcpConnectionPtr &conn)
 {
+    // 客户建立连接，创建连接的会话信息
+    if (conn->connected())
+    {
+        conn->setContext(std::make_shared<Session>(_nextConnId++));
+
+        // 客户端不读取数据时输出缓冲区会无限增长，超过高水位后进入拥塞处理
+        conn->setHighWaterMarkCallback(std::bind(&ChatService::onHighWaterMark, ChatService::instance(), _1, _2),
+                                       ChatService::kHighWaterMark);
+    }
     // 客户断开连接
-    if (!conn->connected())
+    else
     {
-        ChatService::instance()->clientCloseException(conn);
+        // 断开处理也投递到该连接的工作线程，保证在该连接之前的消息处理完之后执行
+        dispatch(conn, [conn]()
+                 { ChatService::instance()->clientCloseException(conn); });
         conn->shutdown();
     }
 }
@@ -44,15 +276,75 @@ void ChatServer::onMessage(const TcpConnectionPtr &conn,
                            Buffer *buffer,
                            Timestamp receiveTime)
 {
-    std::string buf = buffer->retrieveAllAsString();
+    // 消息帧格式：4字节大端长度前缀 + JSON数据或二进制消息，与ChatService::sendWithLengthPrefix保持一致
+    // 一次读事件可能包含多个完整帧，也可能只有半个帧，循环解码所有完整帧，不完整的帧留在Buffer中等待后续数据
+    while (buffer->readableBytes() >= kHeaderLen)
+    {
+        // peekInt32只查看不取出，并完成网络字节序到本地字节序的转换
+        uint32_t len = static_cast<uint32_t>(buffer->peekInt32());
+        if (len > kMaxMessageLen)
+        {
+            // 长度非法，后续数据已无法找到帧边界，直接断开连接
+            LOG_ERROR << "invalid message length:" << len << " from " << conn->name();
+            buffer->retrieveAll();
+            conn->forceClose();
+            break;
+        }
 
-    // 数据的反序列化
-    json js = json::parse(buf);
+        if (buffer->readableBytes() < kHeaderLen + len)
+        {
+            // 半包，等待剩余数据到达
+            break;
+        }
 
-    // 达到的目的：完全解耦网络模块的代码和业务模块的代码
-    // 通过js["msgid"] 获取 => 业务handler =>conn js time
-    auto msgHandler = ChatService::instance()->getHandler(js["msgid"].get<int>()); // js["msgid"]虽然返回数值，但还是json类型，需要使用get模板方法强转为int
+        buffer->retrieve(kHeaderLen);
+        std::string message = buffer->retrieveAsString(len);
 
-    // 回调消息绑定好的事件处理器，来执行相应的业务处理
-    msgHandler(conn, js, receiveTime);
-}
\ No newline at end of file
+        try
+        {
+            // 数据的反序列化在IO线程中完成，业务处理投递到业务线程池执行
+            // 二进制编码的聊天消息转换成与JSON消息相同的字段，业务层不需要区分两种编码
+            json js;
+            if (BinaryCodec::isBinary(message.data(), message.size()))
+            {
+                BinaryCodec::ChatMessage chatMsg;
+                if (!BinaryCodec::decode(message.data(), message.size(), chatMsg))
+                {
+                    LOG_ERROR << "bad binary message from " << conn->name();
+                    continue;
+                }
+                js = BinaryCodec::toJson(chatMsg);
+            }
+            else
+            {
+                // 一对一聊天消息只需要msgid和to两个字段就能路由，扫描校验语法和接收者读取的字段类型后直接转发原始字节，省去反序列化和序列化
+                // 扫描失败、字段类型不对或者其它类型的消息走下面的完整解析
+                JsonRouteScanner scanner;
+                int msgid = 0, toId = 0;
+                if (scanner.scan(message.data(), message.size()) && scanner.msgid(msgid) && msgid == ONE_CHAT_MSG && scanner.to(toId) &&
+                    scanner.chatFields())
+                {
+                    auto raw = std::make_shared<std::string>(std::move(message));
+                    dispatch(conn, [conn, toId, raw]()
+                             { ChatService::instance()->forwardOneChat(conn, toId, *raw); });
+                    continue;
+                }
+                js = json::parse(message);
+            }
+
+            // 达到的目的：完全解耦网络模块的代码和业务模块的代码
+            // 通过js["msgid"] 获取 => 业务handler =>conn js time
+            auto msgHandler = ChatService::instance()->getHandler(js["msgid"].get<int>()); // js["msgid"]虽然返回数值，但还是json类型，需要使用get模板方法强转为int
+
+            // 回调消息绑定好的事件处理器，来执行相应的业务处理
+            auto request = std::make_shared<json>(std::move(js));
+            dispatch(conn, [conn, msgHandler, request, receiveTime]()
+                     { msgHandler(conn, *request, receiveTime); });
+        }
+        catch (const json::exception &e)
+        {
+            // 帧边界由长度前缀确定，单个帧内容错误不影响后续帧的解码
+            LOG_ERROR << "bad message from " << conn->name() << ":" << e.what();
+        }
+    }
+}
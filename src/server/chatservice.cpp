@@ -1,11 +1,42 @@
 #include "chatservice.hpp"
 #include "public.hpp"
+#include "jsonroutescanner.hpp"
 #include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
 #include <string>
 #include <cstring>
 #include <vector>
+#include <algorithm>
 #include <iostream>
 
+// 广播群组成员变更的通道，各节点收到后删除本地的成员索引
+static const string kGroupInvalidateChannel = "chat:invalidate:group";
+// 广播用户数据变更的通道，各节点收到后删除本地的用户缓存
+static const string kUserInvalidateChannel = "chat:invalidate:user";
+
+// 解析缓存失效通知，格式：数据id 发起修改的节点id，本节点自己发出的通知返回false
+static bool parseInvalidate(const string &data, const string &nodeId, int &id)
+{
+    size_t pos = data.find(' ');
+    if (pos == string::npos || data.compare(pos + 1, string::npos, nodeId) == 0)
+    {
+        return false;
+    }
+    id = atoi(data.c_str());
+    return true;
+}
+
+// 把JSON数组的每个元素单独序列化成字符串，用于v1协议的登录响应
+static json dumpElements(const json &arr)
+{
+    json result = json::array();
+    for (const json &elem : arr)
+    {
+        result.push_back(elem.dump());
+    }
+    return result;
+}
+
 // 获取单例对象的接口函数
 ChatService *ChatService::instance()
 {
@@ -15,6 +46,7 @@ ChatService *ChatService::instance()
 
 // 注册消息以及对应的Handler回调操作
 ChatService::ChatService()
+    : _presenceModel(&_redis)
 {
     // 用户基本业务管理相关事件处理回调注册
     _msgHandlerMap.insert({LOGIN_MSG, std::bind(&ChatService::login, this, _1, _2, _3)});
@@ -22,32 +54,98 @@ ChatService::ChatService()
     _msgHandlerMap.insert({REG_MSG, std::bind(&ChatService::reg, this, _1, _2, _3)});
     _msgHandlerMap.insert({ONE_CHAT_MSG, std::bind(&ChatService::oneChat, this, _1, _2, _3)});
     _msgHandlerMap.insert({ADD_FRIEND_MSG, std::bind(&ChatService::addFriend, this, _1, _2, _3)});
+    _msgHandlerMap.insert({OFFLINE_SYNC_MSG, std::bind(&ChatService::offlineSync, this, _1, _2, _3)});
+    _msgHandlerMap.insert({OFFLINE_ACK_MSG, std::bind(&ChatService::offlineAck, this, _1, _2, _3)});
 
     // 群组业务管理相关事件处理回调注册
     _msgHandlerMap.insert({CREAT_GROUP_MSG, std::bind(&ChatService::creatGroup, this, _1, _2, _3)});
     _msgHandlerMap.insert({ADD_GROUP_MSG, std::bind(&ChatService::addToGroup, this, _1, _2, _3)});
     _msgHandlerMap.insert({GROUP_CHAT_MSG, std::bind(&ChatService::groupChat, this, _1, _2, _3)});
 
+}
+
+// 启动业务：连接redis服务器，订阅本节点的通道，取得本节点的在线状态租约
+void ChatService::init(const string &nodeId)
+{
+    _nodeId = nodeId;
+
     // 连接redis服务器
     if (_redis.connect())
     {
         // 设置上报消息的回调
         _redis.init_notify_handler(std::bind(&ChatService::handleRedisSubscribeMessage, this, _1, _2));
 
-        // // 在 ChatService 初始化 Redis 回调时，替换为纯打印逻辑
-        // _redis.init_notify_handler([this](int user_id, string msg)
-        //                            {
-        // // 仅打印消息，不做任何业务处理（如解析 JSON、操作容器等）
-        // std::cout << "【纯打印】收到消息：user_id=" << user_id << ", msg=" << msg << std::endl;
-        // std::cout << "【纯打印】消息长度：" << msg.size() << "字节，首字符：" << (msg.empty() ? ' ' : msg[0]) << std::endl; });
+        // 每个节点只订阅一次自己的节点通道，发给本节点用户的消息都通过该通道转发，用户登录下线不再订阅和取消订阅
+        _redis.subscribe(nodeChannel(_nodeId));
+
+        // 清理本节点上次运行遗留的在线记录，然后取得本节点的租约
+        _presenceModel.clearNode(_nodeId);
+        _presenceModel.refreshLease(_nodeId);
+
+        // 群组成员在本节点修改后，通知其它节点删除成员索引
+        _redis.subscribe(kGroupInvalidateChannel);
+        GroupCache::instance()->setInvalidateNotifier([this](int id)
+                                                      { _redis.publish(kGroupInvalidateChannel, to_string(id) + " " + _nodeId); });
+
+        // 用户数据在本节点修改后，通知其它节点删除用户缓存，不必等到缓存过期
+        _redis.subscribe(kUserInvalidateChannel);
+        UserCache::instance()->setInvalidateNotifier([this](int id)
+                                                     { _redis.publish(kUserInvalidateChannel, to_string(id) + " " + _nodeId); });
+    }
+}
+
+// 节点通道名
+string ChatService::nodeChannel(const string &nodeId)
+{
+    return "chat:node:" + nodeId;
+}
+
+// 把消息转发给其它节点上的用户，同一节点上的多个接收者合并成一条信封发布
+void ChatService::relay(const string &nodeId, const vector<int> &targets, const string &msg, int groupId, int seq)
+{
+    bool inTimeline = seq > 0;
+    // 目标节点在查询在线状态之后退出时，没有订阅者收到这条消息，接收者按离线处理
+    auto fallback = [this, nodeId, targets, msg, inTimeline](bool ok, long long receivers)
+    {
+        if (ok && receivers > 0)
+        {
+            return;
+        }
+        LOG_ERROR << "relay to node " << nodeId << (ok ? " has no subscriber" : " failed") << ", "
+                  << targets.size() << " receivers offline";
+        if (!inTimeline)
+        {
+            _offlineMsgModel.insert(targets, msg);
+        }
+    };
+    if (!_redis.publish(nodeChannel(nodeId), RelayEnvelope::encode(targets, msg, groupId, seq), fallback))
+    {
+        fallback(false, 0);
     }
 }
 
 // 服务器异常，业务重置方法
 void ChatService::reset()
 {
-    // 把online状态的用户，设置成offline
-    _userModel.resetState();
+    // 删除本节点上所有用户的在线记录，不再等待租约过期
+    _presenceModel.clearNode(_nodeId);
+}
+
+// 续约本节点的在线状态租约，并删除租约已经到期的节点上的在线记录，需要定期调用
+void ChatService::refreshPresence()
+{
+    _presenceModel.refreshLease(_nodeId);
+    _presenceModel.reapExpiredNodes();
+}
+
+// 删除所有成员都已经读过的群组时间线消息，需要定期在业务线程中调用
+void ChatService::pruneGroupMessages()
+{
+    int rows = _groupMessageModel.prune();
+    if (rows > 0)
+    {
+        LOG_INFO << "pruned " << rows << " group messages";
+    }
 }
 
 // 获取消息对应的处理器
@@ -76,7 +174,9 @@ void ChatService::login(const TcpConnectionPtr &conn, json &js, Timestamp time)
     User user = _userModel.query(id);
     if (user.getId() == id && user.getPwd() == pwd)
     {
-        if (user.getState() == "online")
+        // 在redis中原子地检查并记录用户所在的节点，其它节点据此把消息发布到本节点的通道
+        PresenceModel::OnlineResult online = _presenceModel.setOnline(id, _nodeId);
+        if (online == PresenceModel::ONLINE_ALREADY)
         {
             // 该用户已登录
             json response;
@@ -88,80 +188,124 @@ void ChatService::login(const TcpConnectionPtr &conn, json &js, Timestamp time)
 
             sendWithLengthPrefix(conn, response);
         }
+        else if (online == PresenceModel::ONLINE_ERROR)
+        {
+            // redis不可用或超时，用户的在线状态没有改变，可以稍后重试
+            json response;
+            response["msgid"] = LOGIN_MSG_ACK;
+            response["errno"] = 3;
+            response["errmsg"] = "服务器繁忙,请稍后重试";
+            sendWithLengthPrefix(conn, response);
+        }
         else
         {
-            // 登录成功，记录用户连接信息
+            // 记录各群组时间线的同步范围：已读位置到当前的最新序号，由客户端通过OFFLINE_SYNC_MSG分页读取
+            // 必须在加入在线用户表之前读取最新序号，之后实时送达的时间线消息序号都大于同步范围
+            SessionPtr session = getSession(conn);
+            _groupMessageModel.initCursors(id);
+            unordered_map<int, pair<int, int>> ranges = _groupMessageModel.querySyncRanges(id);
+            if (session)
             {
-                lock_guard<mutex> lock(_connMutex);
-                _userConnMap.insert({id, conn});
+                for (auto &range : ranges)
+                {
+                    session->trackGroup(range.first, range.second.first, range.second.second);
+                }
             }
 
-            // id用户登录成功后，向redis订阅channel(id)
-            _redis.subscribe(id);
+            // 登录成功，记录用户连接信息，并在连接会话中记录登录的用户
+            _onlineUsers.insert(id, conn);
+            if (session)
+            {
+                session->login(id);
+            }
 
-            // 登录成功，更新用户状态信息 state offline => online
-            user.setState("online");
-            _userModel.updateState(user);
+            // 客户端在登录请求中要求使用二进制编码，之后发给该连接的聊天消息都使用二进制编码
+            bool binary = js.contains("binary") && js["binary"].get<bool>();
+            if (session && binary)
+            {
+                session->binary = true;
+            }
 
             json response;
             response["msgid"] = LOGIN_MSG_ACK;
             response["errno"] = 0; // 业务成功
             response["id"] = user.getId();
             response["name"] = user.getName();
-
-            // 查询该用户是否有离线消息
-            vector<string> vec = _offlineMsgModel.query(id);
-            if (!vec.empty())
+            if (binary)
             {
-                response["offlinemsg"] = vec;
-
-                // 读取该用户的离线消息后，把该用户的所有离线消息删除掉
-                _offlineMsgModel.remove(id);
+                response["binary"] = true;
             }
 
-            // 查询该用户的好友信息并返回
+            // 个人离线消息和群组时间线上的未读消息都不放在登录响应中，由客户端登录成功后通过OFFLINE_SYNC_MSG分页拉取
+
+            // 查询该用户的好友信息和群组信息
             vector<User> userVec = _friendModel.query(id);
-            if (!userVec.empty())
+            vector<Group> groupuserVec = _groupModel.queryGroups(id);
+
+            // 好友和群成员的在线状态一次批量从redis中查询
+            unordered_set<int> onlineSet = queryOnline(userVec, groupuserVec);
+
+            // 好友和群组信息先组织成嵌套的JSON对象
+            json friends = json::array();
+            for (User &user : userVec)
+            {
+                json js;
+                js["id"] = user.getId();
+                js["name"] = user.getName();
+                js["state"] = onlineSet.count(user.getId()) ? "online" : "offline";
+                friends.push_back(std::move(js));
+            }
+
+            // group:[{id,groupname,groupdesc,users:[{id,name,state,role}]}]
+            json groups = json::array();
+            for (Group &group : groupuserVec)
             {
-                vector<string> reVec;
-                for (User &user : userVec)
+                json group_js;
+                group_js["id"] = group.getId();
+                group_js["groupname"] = group.getName();
+                group_js["groupdesc"] = group.getDesc();
+
+                json users = json::array();
+                for (GroupUser &user : group.getGroupUser())
                 {
                     json js;
                     js["id"] = user.getId();
                     js["name"] = user.getName();
-                    js["state"] = user.getState();
-                    reVec.push_back(js.dump());
+                    js["state"] = onlineSet.count(user.getId()) ? "online" : "offline";
+                    js["role"] = user.getRole();
+                    users.push_back(std::move(js));
                 }
-                response["friends"] = reVec;
+                group_js["users"] = std::move(users);
+                groups.push_back(std::move(group_js));
             }
 
-            // 查询用户的群组信息
-            vector<Group> groupuserVec = _groupModel.queryGroups(id);
-            if (!groupuserVec.empty())
+            // 客户端在登录请求中声明协议版本，v2直接返回嵌套的对象，整个响应只序列化一次
+            // 没有声明版本的旧客户端按v1返回，每个元素单独序列化成字符串
+            int version = js.contains("version") ? js["version"].get<int>() : PROTOCOL_V1;
+            if (version >= PROTOCOL_V2)
             {
-                // group:[{group_id:[xxx,xxx,xxx,xxx]}]
-                vector<string> groupVec;
-                for (Group &group : groupuserVec)
+                response["version"] = PROTOCOL_V2;
+            }
+            else
+            {
+                for (json &group_js : groups)
                 {
-                    json group_js;
-                    group_js["id"] = group.getId();
-                    group_js["groupname"] = group.getName();
-                    group_js["groupdesc"] = group.getDesc();
-
-                    vector<string> userVec;
-                    for (GroupUser &user : group.getGroupUser())
-                    {
-                        json js;
-                        js["id"] = user.getId();
-                        js["name"] = user.getName();
-                        js["state"] = user.getState();
-                        js["role"] = user.getRole();
-                        userVec.push_back(js.dump());
-                    }
-                    group_js["users"] = userVec;
-                    groupVec.push_back(group_js.dump());
+                    group_js["users"] = dumpElements(group_js["users"]);
                 }
-                response["groups"] = groupVec;
+                friends = dumpElements(friends);
+                groups = dumpElements(groups);
+            }
+
+            // 返回好友信息
+            if (!friends.empty())
+            {
+                response["friends"] = std::move(friends);
+            }
+
+            // 返回用户的群组信息
+            if (!groups.empty())
+            {
+                response["groups"] = std::move(groups);
             }
 
             // conn->send(response.dump());
@@ -217,90 +361,325 @@ void ChatService::reg(const TcpConnectionPtr &conn, json &js, Timestamp time)
 // 处理注销业务
 void ChatService::loginout(const TcpConnectionPtr &conn, json &js, Timestamp time)
 {
-    int user_id = js["id"].get<int>();
+    // 以连接会话中记录的登录用户为准，注销之后再断开连接不会重复下线
+    SessionPtr session = getSession(conn);
+    int user_id = session ? session->logout() : -1;
+    if (user_id != -1)
+    {
+        userOffline(user_id, conn);
+    }
+}
+
+// 处理客户端异常退出
+void ChatService::clientCloseException(const TcpConnectionPtr &conn)
+{
+    // 从连接会话中直接取出登录的用户，不需要遍历在线用户表
+    SessionPtr session = getSession(conn);
+    int user_id = session ? session->logout() : -1;
+    if (user_id != -1)
+    {
+        userOffline(user_id, conn);
+    }
+}
+
+// 用户下线：前移群消息已读位置，删除连接信息，删除在线状态
+void ChatService::userOffline(int user_id, const TcpConnectionPtr &conn)
+{
+    // 在线用户表中记录的已经是该用户的新连接，说明用户已经重新登录，在线状态和已读位置都属于新的登录，不能修改
+    if (_onlineUsers.find(user_id) != conn)
+    {
+        return;
+    }
+
+    // 已读位置只前移到实际写入该连接的时间线消息，没有送达的消息序号仍大于已读位置，下次登录时读到
+    SessionPtr session = getSession(conn);
+    if (session)
+    {
+        saveGroupCursors(user_id, session);
+    }
+
+    // 从在线用户表删除用户的连接信息，删除失败同样说明新的登录已经取代了这个连接
+    if (!_onlineUsers.remove(user_id, conn))
+    {
+        return;
+    }
+
+    // 用户注销，相当于就是下线，在redis中删除用户所在的节点
+    _presenceModel.setOffline(user_id, _nodeId);
+}
+
+// 用户下线时保存群组时间线的已读位置
+// 同步完成的群组中，序号大于同步范围的时间线消息全部实时送达时，已读位置前移到送达的最大序号
+// 有消息没有送达（登录过程中存储的消息、下线过程中发送失败的消息）时已读位置保持不变，下次登录时重新同步
+void ChatService::saveGroupCursors(int user_id, const SessionPtr &session)
+{
+    unordered_map<int, Session::GroupTimeline> timelines = session->takeGroupTimelines();
+    unordered_map<int, pair<int, int>> ranges;
+    for (auto &timeline : timelines)
     {
-        lock_guard<mutex> lock(_connMutex);
-        auto it = _userConnMap.find(user_id);
-        if (it != _userConnMap.end())
+        const Session::GroupTimeline &state = timeline.second;
+        if (state.tracked && state.acked >= state.bound && state.liveCount > 0)
         {
-            _userConnMap.erase(it);
+            ranges[timeline.first] = make_pair(state.bound, state.lastLive);
         }
     }
 
-    // 用户注销，相当于就是下线，在redis中取消订阅通道
-    _redis.unsubscribe(user_id);
-
-    // 更新用户的状态信息
-    User user(user_id, "", "", "offline");
-    _userModel.updateState(user);
+    unordered_map<int, int> counts = _groupMessageModel.countRanges(ranges);
+    unordered_map<int, int> seqs;
+    for (auto &range : ranges)
+    {
+        auto count = counts.find(range.first);
+        if (count != counts.end() && count->second == timelines[range.first].liveCount)
+        {
+            seqs[range.first] = range.second.second;
+        }
+    }
+    _groupMessageModel.advanceCursors(user_id, seqs);
 }
 
-// 处理客户端异常退出
-void ChatService::clientCloseException(const TcpConnectionPtr &conn)
+// 批量查询好友和群成员中在线的用户
+unordered_set<int> ChatService::queryOnline(vector<User> &friends, vector<Group> &groups)
 {
-    User user;
+    vector<int> ids;
+    for (User &user : friends)
+    {
+        ids.push_back(user.getId());
+    }
+    for (Group &group : groups)
     {
-        lock_guard<mutex> lock(_connMutex);
-        for (auto it = _userConnMap.begin(); it != _userConnMap.end(); ++it)
+        for (GroupUser &user : group.getGroupUser())
         {
-            if (it->second == conn)
-            {
-                // 从map表删除用户的连接信息
-                user.setId(it->first);
-                _userConnMap.erase(it);
-                break;
-            }
+            ids.push_back(user.getId());
         }
     }
 
-    // 用户注销，相当于就是下线，在redis中取消订阅通道
-    _redis.unsubscribe(user.getId());
+    // 同一个用户可能同时是好友和多个群的成员，去重后再查询
+    sort(ids.begin(), ids.end());
+    ids.erase(unique(ids.begin(), ids.end()), ids.end());
 
-    // 更新用户的状态信息
-    if (user.getId() != -1)
+    unordered_set<int> onlineSet;
+    vector<string> nodeVec = _presenceModel.query(ids);
+    for (size_t i = 0; i < ids.size(); ++i)
     {
-        user.setState("offline");
-        _userModel.updateState(user);
+        if (!nodeVec[i].empty())
+        {
+            onlineSet.insert(ids[i]);
+        }
     }
+    return onlineSet;
 }
 
 // 一对一聊天业务
 void ChatService::oneChat(const TcpConnectionPtr &conn, json &js, Timestamp time)
 {
-    int toId = js["to"].get<int>();
+    if (!checkChatMessage(js, "to"))
+    {
+        LOG_ERROR << "bad chat message from " << conn->name();
+        return;
+    }
+    forwardOneChat(conn, js["to"].get<int>(), js.dump(), &js);
+}
+
+// 聊天消息中接收者读取的字段类型是否都正确，toKey是一对一聊天的to或群聊的group_id
+// 消息原样转发给接收者，类型不对的消息在这里丢弃，不能转发给客户端
+bool ChatService::checkChatMessage(const json &js, const char *toKey)
+{
+    auto isInt = [&js](const char *key)
+    {
+        auto it = js.find(key);
+        return it != js.end() && it->is_number_integer() && it->get<int64_t>() >= INT32_MIN && it->get<int64_t>() <= INT32_MAX &&
+               !(it->is_number_unsigned() && it->get<uint64_t>() > static_cast<uint64_t>(INT32_MAX));
+    };
+    auto isString = [&js](const char *key)
+    {
+        auto it = js.find(key);
+        return it != js.end() && it->is_string();
+    };
+    return js.is_object() && isInt("id") && isInt(toKey) && isString("name") && isString("msg") && isString("time");
+}
+
+// 转发一对一聊天消息，msg是完整的JSON消息，原样转发给接收者
+// js是调用方已经解析好的消息，接收者协商了二进制编码时直接用它编码，没有时为nullptr
+void ChatService::forwardOneChat(const TcpConnectionPtr &conn, int toId, const string &msg, const json *js)
+{
+    // toId在本服务器上，直接转发
+    TcpConnectionPtr toConn = _onlineUsers.find(toId);
+    if (toConn)
+    {
+        deliverLocal({{toId, toConn}}, makeFrame(msg), js);
+        return;
+    }
+
+    // 查询toid所在的节点(通过Redis跨服务器通信场景)
+    // 在线状态记录在本节点但在线用户表中没有，说明用户正在下线，按离线处理，不能转发给自己
+    string node = _presenceModel.query({toId})[0];
+    if (!node.empty() && node != _nodeId)
+    {
+        // 信封中携带已经封装好长度前缀的消息帧，接收方服务器不再解析，直接发送给客户端
+        relay(node, {toId}, msg);
+        return;
+    }
+
+    // toId不在线，离线消息(存储原始JSON字符串，用户上线时添加长度前缀发送)
+    _offlineMsgModel.insert(toId, msg);
+}
+
+// 离线消息同步业务  msgid cursor groups
+// 先删除客户端已经确认的cursor之前的个人离线消息，前移groups中确认的群组已读位置，
+// 再返回下一页：先是个人离线消息，个人离线消息读完后是群组时间线上的未读消息，每次同步占用的内存不超过一页
+void ChatService::offlineSync(const TcpConnectionPtr &conn, json &js, Timestamp time)
+{
+    // 以连接会话中登录的用户为准，不能同步或删除其它用户的离线消息
+    SessionPtr session = getSession(conn);
+    int user_id = session ? session->userId.load() : -1;
+    if (user_id == -1)
+    {
+        return;
+    }
+
+    int cursor = js["cursor"].get<int>();
+    if (cursor > 0)
+    {
+        _offlineMsgModel.remove(user_id, cursor);
+    }
+    ackGroups(user_id, session, js);
+
+    // 转存的消息数量，同步完成后据此判断同步期间是否又有消息转存
+    unsigned diverted = session->divertedFrames;
+
+    // 等待之前存储的离线消息写入数据库，保证登录前刚存储的离线消息能被读到
+    // 没有全部写入时这一页可能缺少消息，客户端收到确认后的位置稍后重新请求，不能返回不完整的一页
+    if (!_offlineMsgModel.flush())
+    {
+        json response;
+        response["msgid"] = OFFLINE_SYNC_MSG_ACK;
+        response["errno"] = 3;
+        response["errmsg"] = "服务器繁忙,请稍后重试";
+        response["cursor"] = cursor;
+        sendWithLengthPrefix(conn, response);
+        return;
+    }
+    vector<pair<int, string>> page = _offlineMsgModel.query(user_id, cursor, kOfflinePageSize);
+
+    vector<string> msgs;
+    msgs.reserve(page.size());
+    for (auto &msg : page)
+    {
+        msgs.push_back(std::move(msg.second));
+    }
+
+    // 个人离线消息不满一页时，用群组时间线上的未读消息补满
+    json groups = json::object();
+    bool more = page.size() == static_cast<size_t>(kOfflinePageSize);
+    if (!more)
+    {
+        more = !syncGroupMessages(session, kOfflinePageSize - static_cast<int>(page.size()), msgs, groups);
+    }
 
-    // 访问连接信息表，必须保证线程安全
+    json response;
+    response["msgid"] = OFFLINE_SYNC_MSG_ACK;
+    response["errno"] = 0;
+    response["msgs"] = msgs;
+    response["cursor"] = page.empty() ? cursor : page.back().first;
+    if (!groups.empty())
     {
-        lock_guard<mutex> lock(_connMutex);
-        auto it = _userConnMap.find(toId);
-        if (it != _userConnMap.end())
+        response["groups"] = std::move(groups);
+    }
+    response["more"] = more;
+    sendWithLengthPrefix(conn, response);
+
+    // 转存的消息已经同步完，在IO线程中恢复实时发送，排在这一页之后
+    // 同步期间又有消息转存时再通知客户端同步一次，仍然拥塞时等解除拥塞时再通知
+    if (!more && session->resyncing)
+    {
+        conn->getLoop()->runInLoop([this, conn, session, diverted]()
+                                   {
+            if (session->divertedFrames == diverted)
+            {
+                session->resyncing = false;
+            }
+            else if (!session->congested && conn->connected())
+            {
+                notifyOfflineSync(conn);
+            } });
+    }
+}
+
+// 读取还没有同步完的群组的时间线消息，最多limit条，groups中返回每个群组本页同步到的序号，全部同步完返回true
+bool ChatService::syncGroupMessages(const SessionPtr &session, int limit, vector<string> &msgs, json &groups)
+{
+    for (auto &group : session->unsyncedGroups())
+    {
+        if (limit <= 0)
+        {
+            return false;
+        }
+
+        int group_id = group.first;
+        int acked = group.second.first, bound = group.second.second;
+        vector<GroupMessage> vec = _groupMessageModel.queryRange(group_id, acked, bound, limit);
+        for (GroupMessage &msg : vec)
         {
-            // it->second->send(js.dump());
-            // return;
+            msgs.push_back(msg.getMessage());
+        }
 
-            sendWithLengthPrefix(it->second, js);
-            return;
+        // 不满limit条说明同步范围内的消息已经读完，客户端确认到范围的上限
+        if (static_cast<int>(vec.size()) < limit)
+        {
+            groups[to_string(group_id)] = bound;
+            limit -= static_cast<int>(vec.size());
         }
+        else
+        {
+            groups[to_string(group_id)] = vec.back().getSeq();
+            return false;
+        }
+    }
+    return true;
+}
+
+// 前移客户端在groups中确认的群组已读位置，groups为群组id -> 已经收到的序号
+void ChatService::ackGroups(int user_id, const SessionPtr &session, const json &js)
+{
+    auto it = js.find("groups");
+    if (it == js.end() || !it->is_object())
+    {
+        return;
     }
 
-    // 查询toid是否在线(通过Redis跨服务器通信场景)
-    User user = _userModel.query(toId);
-    if (user.getState() == "online")
+    unordered_map<int, int> seqs;
+    for (auto &group : it->items())
     {
-        // // 生成 JSON 字符串并打印（验证是否有效）
-        // std::string json_str = js.dump();
-        // std::cout << "准备发布到 Redis 的消息：" << json_str << std::endl;
-        // std::cout << "消息长度:" << json_str.size() << " 字节" << std::endl;
-        // std::cout << "消息前5个字符:" << json_str.substr(0, 5) << std::endl; // 确认开头是否为 '{'
+        if (!group.value().is_number_integer())
+        {
+            continue;
+        }
+        int group_id = atoi(group.key().c_str());
+        int seq = session->ackGroup(group_id, group.value().get<int>());
+        if (seq > 0)
+        {
+            seqs[group_id] = seq;
+        }
+    }
+    _groupMessageModel.advanceCursors(user_id, seqs);
+}
 
-        // 注意：Redis发布的是原始JSON字符串（不含长度前缀），
-        // 接收方服务器从Redis订阅消息后，仍需按上述逻辑添加长度前缀再发送给客户端
-        _redis.publish(toId, js.dump());
+// 离线消息确认业务  msgid cursor groups
+void ChatService::offlineAck(const TcpConnectionPtr &conn, json &js, Timestamp time)
+{
+    SessionPtr session = getSession(conn);
+    int user_id = session ? session->userId.load() : -1;
+    if (user_id == -1)
+    {
         return;
     }
 
-    // toId不在线，离线消息(存储原始JSON字符串，用户上线时添加长度前缀发送)
-    _offlineMsgModel.insert(toId, js.dump());
+    int cursor = js["cursor"].get<int>();
+    if (cursor > 0)
+    {
+        _offlineMsgModel.remove(user_id, cursor);
+    }
+    ackGroups(user_id, session, js);
 }
 
 // 添加好友业务  msgid user_id friend_id
@@ -327,6 +706,8 @@ void ChatService::creatGroup(const TcpConnectionPtr &conn, json &js, Timestamp t
     {
         // 存储群组创建人信息
         _groupModel.addGroup(group.getId(), user_id, CREATOR);
+        _groupMessageModel.initCursor(user_id, group.getId());
+        trackJoinedGroup(conn, user_id, group.getId());
     }
 }
 
@@ -336,85 +717,217 @@ void ChatService::addToGroup(const TcpConnectionPtr &conn, json &js, Timestamp t
     int user_id = js["id"].get<int>();
     int group_id = js["group_id"].get<int>();
     _groupModel.addGroup(group_id, user_id, NORMAL);
+    _groupMessageModel.initCursor(user_id, group_id);
+    trackJoinedGroup(conn, user_id, group_id);
+}
+
+// 登录期间加入的群组从加入时的已读位置开始记录送达状态，下线时同样可以前移已读位置
+void ChatService::trackJoinedGroup(const TcpConnectionPtr &conn, int user_id, int group_id)
+{
+    SessionPtr session = getSession(conn);
+    if (session && session->userId == user_id)
+    {
+        int cursor = _groupMessageModel.queryCursor(user_id, group_id);
+        session->trackGroup(group_id, cursor, cursor);
+    }
 }
 
 // 群组聊天业务
 void ChatService::groupChat(const TcpConnectionPtr &conn, json &js, Timestamp time)
 {
+    if (!checkChatMessage(js, "group_id"))
+    {
+        LOG_ERROR << "bad group chat message from " << conn->name();
+        return;
+    }
     int user_id = js["id"].get<int>();
     int group_id = js["group_id"].get<int>();
     vector<int> user_idVec = _groupModel.queryGroupUsers(user_id, group_id);
 
-    lock_guard<mutex> lock(_connMutex);
-    for (int id : user_idVec)
+    // 先确定每个成员的位置，所有成员都在线时消息只实时转发，不写数据库
+    Route route;
+    routeTargets(user_idVec, route);
+
+    // 有成员不在线时消息在群组时间线上存储一份并带上序号，离线成员登录时按已读位置读取
+    int seq = 0;
+    if (!route.offlineVec.empty())
     {
-        auto it = _userConnMap.find(id);
-        if (it != _userConnMap.end())
+        seq = _groupMessageModel.nextSeq(group_id);
+        if (seq > 0)
         {
-            // 转发消息
-            // it->second->send(js.dump());
+            js["seq"] = seq;
+        }
+    }
+
+    // 群消息只序列化一次，本地群成员共享同一个消息帧，跨服务器转发和时间线存储共用同一个字符串
+    string msg = js.dump();
+    if (seq > 0 && !_groupMessageModel.insert(group_id, seq, msg))
+    {
+        seq = 0;
+    }
+    fanOut(route, msg, &js, group_id, seq);
+
+    // 时间线写入失败时退回到逐个成员存储离线消息
+    if (seq <= 0)
+    {
+        _offlineMsgModel.insert(route.offlineVec, msg);
+    }
+}
 
-            sendWithLengthPrefix(it->second, js);
+// 查找接收者所在的位置，只在查找本节点用户时短暂持有在线用户表各分片的锁
+void ChatService::routeTargets(const vector<int> &targets, Route &route)
+{
+    // 1. 在线用户表的快照：本节点上的用户及其连接，其它用户
+    vector<int> otherVec;
+    _onlineUsers.findMany(targets, route.localVec, otherVec);
+
+    // 2. 一次查询所有其它用户所在的节点，按节点归类
+    vector<string> nodeVec = _presenceModel.query(otherVec);
+    for (size_t i = 0; i < otherVec.size(); ++i)
+    {
+        // 在线状态记录在本节点但在线用户表中没有，说明用户正在下线，按离线处理，不能转发给自己
+        if (!nodeVec[i].empty() && nodeVec[i] != _nodeId)
+        {
+            route.nodeTargets[nodeVec[i]].push_back(otherVec[i]);
         }
         else
         {
-            // 查询id是否在线
-            User user = _userModel.query(id);
-            if (user.getState() == "online")
-            {
-                _redis.publish(id, js.dump());
-                return;
-            }
-            else
-            {
-                // 存储离线群消息
-                _offlineMsgModel.insert(id, js.dump());
-            }
+            route.offlineVec.push_back(otherVec[i]);
         }
     }
 }
 
-// 从redis消息队列中获取订阅的信息
-void ChatService::handleRedisSubscribeMessage(int user_id, string msg)
+// 把消息投递给本节点和其它节点上的在线接收者，不在线的接收者由调用方处理
+void ChatService::fanOut(const Route &route, const string &msg, const json *js, int groupId, int seq)
 {
-    // cout << "【接收方】从Redis订阅到消息：user_id=" << user_id << "，原始消息：" << msg << endl;
-    // cout << "【接收方】消息长度：" << msg.size() << "字节" << endl;
+    // 本节点用户按所属IO线程投递
+    if (!route.localVec.empty())
+    {
+        deliverLocal(route.localVec, makeFrame(msg), js, groupId, seq);
+    }
 
-    // ====== 步骤1：验证接收到的Redis消息是否为有效JSON ======
-    json js;
-    try
+    // 每个节点只发布一条携带所有接收者的信封
+    for (auto &target : route.nodeTargets)
     {
-        js = json::parse(msg); // 解析JSON，若失败直接丢弃
-        // cout << "【接收方】解析后的JSON：" << js.dump(4) << endl; // 格式化输出，确认结构正确
+        relay(target.first, target.second, msg, groupId, seq);
     }
-    catch (const nlohmann::json::parse_error &e)
+}
+
+// 把消息发送给本节点上的多个连接，每种编码的消息帧只创建一次，同一个IO线程上的连接只投递一次回调
+void ChatService::deliverLocal(const vector<pair<int, TcpConnectionPtr>> &localVec, const FramePtr &jsonFrame, const json *js,
+                               int groupId, int seq)
+{
+    FramePtr binaryFrame;
+    unordered_map<EventLoop *, vector<pair<TcpConnectionPtr, FramePtr>>> loopConns;
+    for (auto &local : localVec)
     {
-        cerr << "Redis消息JSON解析失败：" << e.what() << "，原始消息：" << msg << endl;
-        return; // 忽略无效消息，避免转发给客户端导致错误
+        // 协商了二进制编码的连接共享二进制消息帧，其它连接共享JSON消息帧
+        // 二进制消息帧从调用方解析好的消息编码，不再解析JSON消息帧；没有解析好的消息时
+        // （跨服务器转发和快速路径转发的原始JSON）发送JSON消息帧，客户端两种编码都能接收
+        SessionPtr session = getSession(local.second);
+        if (session && session->binary && !binaryFrame)
+        {
+            binaryFrame = js != nullptr ? makeBinaryFrame(*js, jsonFrame) : jsonFrame;
+        }
+        loopConns[local.second->getLoop()].emplace_back(local.second, session && session->binary ? binaryFrame : jsonFrame);
     }
 
-    lock_guard<mutex> lock(_connMutex);
-    auto it = _userConnMap.find(user_id);
-    if (it != _userConnMap.end())
+    for (auto &loopConn : loopConns)
     {
-        // it->second->send(msg);
-        // return;
+        auto conns = make_shared<vector<pair<TcpConnectionPtr, FramePtr>>>(std::move(loopConn.second));
+        loopConn.first->runInLoop([this, conns, groupId, seq]()
+                                  {
+            for (auto &connFrame : *conns)
+            {
+                corkFrame(connFrame.first, connFrame.second, groupId, seq);
+            } });
+    }
+}
 
-        // 关键修改：调用通用发送函数，添加4字节长度前缀
-        // (msg 是 JSON 字符串，需先解析为 json 对象，再传入 sendWithLengthPrefix)
-        try
+// 从redis消息队列中获取订阅的信息
+void ChatService::handleRedisSubscribeMessage(string channel, string data)
+{
+    // 其它节点修改了群组成员或用户数据，删除本地的成员索引或用户缓存，本节点自己发出的通知忽略
+    int id = -1;
+    if (channel == kGroupInvalidateChannel)
+    {
+        if (parseInvalidate(data, _nodeId, id))
         {
-            sendWithLengthPrefix(it->second, js); // 调用封装的发送函数（自动添加长度前缀）
+            GroupCache::instance()->invalidate(id);
         }
-        catch (const nlohmann::json::parse_error &e)
+        return;
+    }
+    if (channel == kUserInvalidateChannel)
+    {
+        if (parseInvalidate(data, _nodeId, id))
         {
-            std::cerr << "Redis 消息解析 JSON 失败：" << e.what() << "，原始消息：" << msg << std::endl;
+            UserCache::instance()->invalidate(id);
         }
         return;
     }
 
-    // 存储该用户的离线消息，通道转发消息的过程中用户下线
-    _offlineMsgModel.insert(user_id, msg);
+    // 解析信封，得到本节点上的接收者、群组时间线的序号和发布节点封装好的消息帧
+    // 信封的结构和消息帧的长度总是校验，路由需要的字段都在信封头部，不扫描消息内容
+    vector<int> targets;
+    int groupId = 0, seq = 0;
+    size_t frameOffset = 0;
+    if (!RelayEnvelope::decode(data, targets, groupId, seq, frameOffset))
+    {
+        cerr << "无效的Redis转发消息，通道：" << channel << endl;
+        return;
+    }
+
+    // 信封中的消息帧原样发送，不再解析JSON
+    // 去掉信封头部后复用data的内存作为消息帧，所有接收者共享
+    data.erase(0, frameOffset);
+    FramePtr frame = make_shared<const string>(std::move(data));
+    const char *payload = frame->data() + RelayEnvelope::kFrameHeaderLen;
+    size_t payloadLen = frame->size() - RelayEnvelope::kFrameHeaderLen;
+
+    // 调试时打开校验模式，不依赖发布节点的校验：扫描JSON语法和接收者读取的字段类型，核对信封头部的序号，
+    // 再用完整的JSON解析器校验一次，发现发布节点版本不一致、其它程序向通道发布的消息以及扫描器与解析器不一致的消息
+    if (_validateRelay && !validateRelayFrame(payload, payloadLen, groupId, seq))
+    {
+        cerr << "无效的Redis转发消息，通道：" << channel << "，原始消息：" << string(payload, payloadLen) << endl;
+        return; // 忽略无效消息，避免转发给客户端导致错误
+    }
+
+    // 所有接收者共享同一个消息帧，转发过程中已经下线的用户存储离线消息
+    // 时间线上的群消息不再存储，已读位置没有越过它，下次登录时从时间线读取
+    vector<pair<int, TcpConnectionPtr>> localVec;
+    vector<int> offlineVec;
+    _onlineUsers.findMany(targets, localVec, offlineVec);
+    if (!localVec.empty())
+    {
+        deliverLocal(localVec, frame, nullptr, groupId, seq);
+    }
+    if (!offlineVec.empty() && seq <= 0)
+    {
+        _offlineMsgModel.insert(offlineVec, string(payload, payloadLen));
+    }
+}
+
+// 校验跨服务器转发的消息帧：合法的聊天消息，接收者读取的字段类型正确，群消息的序号与信封头部一致
+bool ChatService::validateRelayFrame(const char *payload, size_t payloadLen, int groupId, int seq)
+{
+    JsonRouteScanner scanner;
+    int msgid = 0, toId = 0, scannedGroupId = 0, scannedSeq = 0;
+    if (!scanner.scan(payload, payloadLen) || !scanner.msgid(msgid) || !scanner.chatFields() ||
+        !(msgid == ONE_CHAT_MSG ? scanner.to(toId) : msgid == GROUP_CHAT_MSG && scanner.groupId(scannedGroupId)))
+    {
+        return false;
+    }
+    if (seq > 0 && (msgid != GROUP_CHAT_MSG || scannedGroupId != groupId || !scanner.seq(scannedSeq) || scannedSeq != seq))
+    {
+        return false;
+    }
+    return json::accept(payload, payload + payloadLen);
+}
+
+// 打开或关闭跨服务器转发消息的完整校验，在init之前调用
+void ChatService::setRelayValidation(bool on)
+{
+    _validateRelay = on;
 }
 
 // 通用发送函数：添加4字节长度前缀并发送JSON消息
@@ -429,24 +942,291 @@ void ChatService::sendWithLengthPrefix(const TcpConnectionPtr &conn, json &js)
 
     try
     {
-        // 1. 将JSON对象转为字符串
-        std::string json_str = js.dump();
-
-        // 2. 计算JSON长度（转为网络字节序：4字节无符号整数）
-        uint32_t len = htonl(json_str.size()); // 本地字节序→网络字节序（大端）
-
-        // 3. 拼接“4字节长度前缀 + JSON数据”
-        std::string send_data;
-        send_data.resize(4);            // 预留4字节存储长度前缀
-        memcpy(&send_data[0], &len, 4); // 将长度写入前4字节
-        send_data += json_str;          // 拼接JSON字符串
+        // 协商了二进制编码的连接，聊天消息使用二进制编码发送
+        BinaryCodec::ChatMessage chatMsg;
+        SessionPtr session = getSession(conn);
+        if (session && session->binary && BinaryCodec::fromJson(js, chatMsg))
+        {
+            sendFrame(conn, makeFrame(BinaryCodec::encode(chatMsg)));
+            return;
+        }
 
-        // 4. 通过TcpConnection发送完整数据
-        conn->send(send_data);
+        // 将JSON对象转为字符串，封装成消息帧后发送
+        sendFrame(conn, makeFrame(js.dump()));
     }
     catch (const std::exception &e)
     {
         // 捕获JSON序列化或内存操作异常（如json_str过大）
         std::cerr << "发送消息失败：" << e.what() << std::endl;
     }
-}
\ No newline at end of file
+}
+
+// 把序列化好的JSON字符串封装成带长度前缀的消息帧
+FramePtr ChatService::makeFrame(const string &payload)
+{
+    // 1. 计算JSON长度（转为网络字节序：4字节无符号整数）
+    uint32_t len = htonl(payload.size()); // 本地字节序→网络字节序（大端）
+
+    // 2. 拼接“4字节长度前缀 + JSON数据”，只分配一次内存
+    auto frame = std::make_shared<std::string>();
+    frame->reserve(4 + payload.size());
+    frame->append(reinterpret_cast<const char *>(&len), 4);
+    frame->append(payload);
+    return frame;
+}
+
+// 把已经解析的聊天消息编码成二进制消息帧，不支持二进制编码的消息直接返回原来的JSON消息帧
+// 转换过程中的任何异常都只影响这一条消息的编码方式，不能中断投递
+FramePtr ChatService::makeBinaryFrame(const json &js, const FramePtr &jsonFrame)
+{
+    try
+    {
+        BinaryCodec::ChatMessage chatMsg;
+        if (BinaryCodec::fromJson(js, chatMsg))
+        {
+            return makeFrame(BinaryCodec::encode(chatMsg));
+        }
+    }
+    catch (const std::exception &e)
+    {
+        LOG_ERROR << "encode binary frame failed: " << e.what();
+    }
+    return jsonFrame;
+}
+
+// 发送共享的消息帧，投递到连接所属的IO线程中发送，只拷贝智能指针不拷贝数据
+void ChatService::sendFrame(const TcpConnectionPtr &conn, const FramePtr &frame)
+{
+    // 在其它线程直接调用conn->send会把数据拷贝一份再投递到IO线程
+    // 这里投递的回调只持有frame的引用计数，在IO线程中直接从共享数据写入socket
+    conn->getLoop()->runInLoop([this, conn, frame]()
+                               { corkFrame(conn, frame); });
+}
+
+// 连接输出缓冲区超过高水位时由muduo在IO线程中回调，连接进入拥塞状态
+void ChatService::onHighWaterMark(const TcpConnectionPtr &conn, size_t len)
+{
+    recordBuffered(len);
+    SessionPtr session = getSession(conn);
+    if (!session || session->congested)
+    {
+        return;
+    }
+
+    session->congested = true;
+    unsigned congestion = ++session->congestion;
+    ++_congestedConns;
+    LOG_WARN << "slow consumer " << conn->name() << " user:" << session->userId << " buffered bytes:" << len;
+
+    // 输出缓冲区写空时muduo在IO线程中回调，不等下一个消息帧到达就解除拥塞
+    conn->setWriteCompleteCallback([this, session](const TcpConnectionPtr &conn)
+                                   { clearCongestion(conn, session); });
+
+    // 宽限期内输出缓冲区没有降到低水位以下，说明客户端已经不再读取，断开连接释放输出缓冲区
+    conn->getLoop()->runAfter(kSlowConsumerGrace, [this, conn, session, congestion]()
+                              {
+        if (!session->congested || session->congestion != congestion || !conn->connected())
+        {
+            return;
+        }
+        size_t buffered = conn->outputBuffer()->readableBytes();
+        if (buffered < kLowWaterMark)
+        {
+            clearCongestion(conn, session);
+            return;
+        }
+        LOG_WARN << "close slow consumer " << conn->name() << " user:" << session->userId << " buffered bytes:" << buffered;
+        ++_slowConsumerCloses;
+        conn->forceClose();
+        clearCongestion(conn, session); });
+}
+
+// 拥塞连接上的聊天消息转存为离线消息，不再写入输出缓冲区，其它消息返回false照常发送
+bool ChatService::divertFrame(const SessionPtr &session, const FramePtr &frame)
+{
+    int user_id = session->userId;
+    if (user_id == -1)
+    {
+        return false;
+    }
+
+    // 离线消息统一存储JSON，二进制编码的消息帧先转换回JSON
+    const char *payload = frame->data() + 4;
+    size_t payloadLen = frame->size() - 4;
+    string msg;
+    BinaryCodec::ChatMessage chatMsg;
+    if (BinaryCodec::isBinary(payload, payloadLen))
+    {
+        if (!BinaryCodec::decode(payload, payloadLen, chatMsg))
+        {
+            return false;
+        }
+        msg = BinaryCodec::toJson(chatMsg).dump();
+    }
+    else
+    {
+        JsonRouteScanner scanner;
+        int msgid = 0;
+        if (!scanner.scan(payload, payloadLen) || !scanner.msgid(msgid) || !BinaryCodec::supports(msgid))
+        {
+            return false;
+        }
+        msg.assign(payload, payloadLen);
+    }
+
+    // 群组时间线上的消息同样转存到个人离线消息中，调用方记录送达的序号，下线时已读位置越过它，不会从时间线重复读取
+    // 先写入再计数，业务线程看到计数变化时对应的消息已经交给离线消息的批量写入
+    _offlineMsgModel.insert(user_id, msg);
+    session->resyncing = true;
+    ++session->divertedFrames;
+    ++_divertedFrames;
+    return true;
+}
+
+// 输出缓冲区降到低水位以下时解除拥塞状态，拥塞期间有消息转存时通知客户端同步离线消息
+void ChatService::clearCongestion(const TcpConnectionPtr &conn, const SessionPtr &session)
+{
+    if (!session->congested)
+    {
+        return;
+    }
+    session->congested = false;
+    --_congestedConns;
+    conn->setWriteCompleteCallback(WriteCompleteCallback());
+
+    // 转存的消息只在离线消息中，不通知的话客户端要到下次登录才能看到
+    if (session->resyncing && conn->connected())
+    {
+        notifyOfflineSync(conn);
+    }
+}
+
+// 通知客户端有转存的离线消息，客户端收到后发起离线消息同步
+void ChatService::notifyOfflineSync(const TcpConnectionPtr &conn)
+{
+    json js;
+    js["msgid"] = OFFLINE_NOTIFY_MSG;
+    sendWithLengthPrefix(conn, js);
+}
+
+// 记录连接输出缓冲区的字节数，用于统计最大值
+void ChatService::recordBuffered(size_t bytes)
+{
+    size_t cur = _maxBufferedBytes;
+    while (bytes > cur && !_maxBufferedBytes.compare_exchange_weak(cur, bytes))
+    {
+    }
+}
+
+// 设置发送合并的延迟上限，单位秒，默认为0：只合并同一轮事件循环中的消息帧，在init之前调用
+void ChatService::setCorkDelay(double seconds)
+{
+    _corkDelay = seconds;
+}
+
+// 在连接所属的IO线程中调用，把消息帧加入连接的待发送队列，等待合并发送
+void ChatService::corkFrame(const TcpConnectionPtr &conn, const FramePtr &frame, int groupId, int seq)
+{
+    if (!conn->connected())
+    {
+        return;
+    }
+
+    SessionPtr session = getSession(conn);
+    if (!session)
+    {
+        conn->send(frame->data(), static_cast<int>(frame->size()));
+        ++_sentFrames;
+        ++_sentWrites;
+        return;
+    }
+
+    // 拥塞的连接：客户端已经读走足够多的数据则解除拥塞，否则聊天消息不再追加到输出缓冲区
+    if (session->congested && conn->outputBuffer()->readableBytes() + session->pendingBytes < kLowWaterMark)
+    {
+        clearCongestion(conn, session);
+    }
+    // 解除拥塞后客户端同步完转存的消息之前，聊天消息继续转存，客户端按原来的顺序收到
+    if ((session->congested || session->resyncing) && divertFrame(session, frame))
+    {
+        if (seq > 0)
+        {
+            session->recordDelivered(groupId, seq);
+        }
+        return;
+    }
+
+    session->pendingFrames.push_back(frame);
+    session->pendingBytes += frame->size();
+    if (seq > 0)
+    {
+        session->pendingSeqs.emplace_back(groupId, seq);
+    }
+    if (session->pendingBytes >= kMaxCorkBytes)
+    {
+        // 待发送的数据已经足够多，合并等待没有意义，立即发送
+        flushFrames(conn, session);
+        return;
+    }
+    if (session->flushScheduled)
+    {
+        return;
+    }
+
+    // 本轮事件循环中发给该连接的其它消息帧都在发送之前加入队列
+    // queueInLoop的回调在本轮所有事件处理完之后执行，设置了延迟上限时最多再等待_corkDelay秒
+    session->flushScheduled = true;
+    if (_corkDelay > 0)
+    {
+        conn->getLoop()->runAfter(_corkDelay, [this, conn, session]()
+                                  { flushFrames(conn, session); });
+    }
+    else
+    {
+        conn->getLoop()->queueInLoop([this, conn, session]()
+                                     { flushFrames(conn, session); });
+    }
+}
+
+// 在连接所属的IO线程中调用，把待发送队列中的消息帧合并成一次发送
+void ChatService::flushFrames(const TcpConnectionPtr &conn, const SessionPtr &session)
+{
+    // 达到字节上限时已经提前发送，之后安排的回调遇到空队列直接返回
+    session->flushScheduled = false;
+    if (session->pendingFrames.empty())
+    {
+        return;
+    }
+
+    if (conn->connected())
+    {
+        if (session->pendingFrames.size() == 1)
+        {
+            const FramePtr &frame = session->pendingFrames[0];
+            conn->send(frame->data(), static_cast<int>(frame->size()));
+        }
+        else
+        {
+            // 多个消息帧拼接后只调用一次send，输出缓冲区为空时只产生一次write系统调用
+            Buffer &buffer = session->corkBuffer;
+            buffer.ensureWritableBytes(session->pendingBytes);
+            for (const FramePtr &frame : session->pendingFrames)
+            {
+                buffer.append(frame->data(), frame->size());
+            }
+            conn->send(&buffer);
+        }
+        _sentFrames += session->pendingFrames.size();
+        ++_sentWrites;
+        recordBuffered(conn->outputBuffer()->readableBytes());
+
+        for (auto &seq : session->pendingSeqs)
+        {
+            session->recordDelivered(seq.first, seq.second);
+        }
+    }
+
+    session->pendingFrames.clear();
+    session->pendingSeqs.clear();
+    session->pendingBytes = 0;
+}
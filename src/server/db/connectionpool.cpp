@@ -0,0 +1,194 @@
+#include "connectionpool.h"
+#include <muduo/base/Logging.h>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+// 获取连接池单例对象的接口函数
+ConnectionPool *ConnectionPool::instance()
+{
+    static ConnectionPool pool;
+    return &pool;
+}
+
+// 初始化连接池，预先创建_initSize个连接，并启动空闲连接回收线程
+ConnectionPool::ConnectionPool()
+    : _initSize(4),
+      _maxSize(32),
+      _maxIdleTime(60),
+      _pingIdleTime(5),
+      _connectionTimeout(1000),
+      _connectionCnt(0),
+      _quit(false)
+{
+    for (size_t i = 0; i < _initSize; ++i)
+    {
+        MySQL *conn = createConnection();
+        if (conn == nullptr)
+        {
+            break;
+        }
+        _connectionQue.push_back(conn);
+        ++_connectionCnt;
+    }
+
+    _scannerThread = std::thread(std::bind(&ConnectionPool::scannerConnectionTask, this));
+}
+
+// 停止回收线程，关闭所有空闲连接
+ConnectionPool::~ConnectionPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        _quit = true;
+    }
+    _quitCv.notify_all();
+    if (_scannerThread.joinable())
+    {
+        _scannerThread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(_queueMutex);
+    for (MySQL *conn : _connectionQue)
+    {
+        delete conn;
+    }
+    _connectionQue.clear();
+}
+
+// 创建一个新的数据库连接，失败返回nullptr
+MySQL *ConnectionPool::createConnection()
+{
+    MySQL *conn = new MySQL();
+    if (!conn->connect())
+    {
+        delete conn;
+        return nullptr;
+    }
+    conn->refreshAliveTime();
+    return conn;
+}
+
+// 从连接池中借用一个可用连接，超时返回nullptr
+std::shared_ptr<MySQL> ConnectionPool::getConnection()
+{
+    MySQL *conn = nullptr;
+    bool create = false;
+    {
+        std::unique_lock<std::mutex> lock(_queueMutex);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_connectionTimeout);
+        while (_connectionQue.empty())
+        {
+            if (_connectionCnt < _maxSize)
+            {
+                // 还没有达到最大连接数，先占住名额，在锁外建立连接
+                ++_connectionCnt;
+                create = true;
+                break;
+            }
+
+            if (_cv.wait_until(lock, deadline) == std::cv_status::timeout && _connectionQue.empty())
+            {
+                LOG_ERROR << "get mysql connection timeout!";
+                return nullptr;
+            }
+        }
+
+        if (!create)
+        {
+            // 优先借出最近归还的连接，让长时间不用的连接留在队头，便于回收
+            conn = _connectionQue.back();
+            _connectionQue.pop_back();
+        }
+    }
+
+    // 空闲较久的连接可能已经被服务器关闭（wait_timeout），借出前先检测，失效的连接重新建立
+    if (!create && conn->getIdleTime() >= _pingIdleTime && !conn->ping())
+    {
+        LOG_INFO << "mysql connection is broken, reconnect!";
+        delete conn;
+        create = true;
+    }
+
+    if (create)
+    {
+        conn = createConnection();
+        if (conn == nullptr)
+        {
+            std::lock_guard<std::mutex> lock(_queueMutex);
+            --_connectionCnt;
+            _cv.notify_one();
+            return nullptr;
+        }
+    }
+
+    // 自定义删除器：智能指针析构时把连接归还到连接池，而不是关闭连接
+    return std::shared_ptr<MySQL>(conn, [this](MySQL *conn)
+                                  { releaseConnection(conn); });
+}
+
+// 归还连接，已断开的连接直接关闭
+void ConnectionPool::releaseConnection(MySQL *conn)
+{
+    if (conn->isBroken())
+    {
+        delete conn;
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        --_connectionCnt;
+        _cv.notify_one();
+        return;
+    }
+
+    conn->refreshAliveTime();
+    std::lock_guard<std::mutex> lock(_queueMutex);
+    _connectionQue.push_back(conn);
+    _cv.notify_one();
+}
+
+// 在独立线程中定期回收空闲时间超过_maxIdleTime的多余连接
+void ConnectionPool::scannerConnectionTask()
+{
+    while (true)
+    {
+        std::vector<MySQL *> expired;
+        {
+            std::unique_lock<std::mutex> lock(_queueMutex);
+            // 扫描间隔取最大空闲时间的几分之一，连接超出最大空闲时间后最多再保留一个扫描间隔
+            _quitCv.wait_for(lock, std::chrono::milliseconds(_maxIdleTime * 1000 / kScanPerIdleTime), [this]()
+                             { return _quit.load(); });
+            if (_quit)
+            {
+                break;
+            }
+
+            // 队头是空闲最久的连接，保留至少_initSize个连接
+            while (_connectionCnt > _initSize && !_connectionQue.empty() &&
+                   _connectionQue.front()->getIdleTime() >= _maxIdleTime)
+            {
+                expired.push_back(_connectionQue.front());
+                _connectionQue.pop_front();
+                --_connectionCnt;
+            }
+        }
+
+        // 在锁外关闭连接，避免阻塞借用连接的线程
+        for (MySQL *conn : expired)
+        {
+            delete conn;
+        }
+    }
+}
+
+// 当前连接总数（空闲+借出）
+size_t ConnectionPool::size()
+{
+    std::lock_guard<std::mutex> lock(_queueMutex);
+    return _connectionCnt;
+}
+
+// 当前空闲连接数
+size_t ConnectionPool::idleSize()
+{
+    std::lock_guard<std::mutex> lock(_queueMutex);
+    return _connectionQue.size();
+}
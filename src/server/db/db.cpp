@@ -1,5 +1,7 @@
 #include "db.h"
+#include <mysql/errmsg.h>
 #include <muduo/base/Logging.h>
+#include <cstring>
 
 // 数据库配置信息
 static std::string server = "127.0.0.1";
@@ -9,13 +11,21 @@ static std::string dbname = "chat";
 
 // 初始化数据库连接
 MySQL::MySQL()
+    : _broken(false)
 {
     _conn = mysql_init(nullptr);
+    _alivetime = std::chrono::steady_clock::now();
 }
 
 // 释放数据库连接资源
 MySQL::~MySQL()
 {
+    // 预处理语句属于连接，必须在关闭连接之前释放
+    for (auto &stmt : _stmts)
+    {
+        mysql_stmt_close(stmt.second);
+    }
+
     if (_conn != nullptr)
     {
         mysql_close(_conn);
@@ -66,4 +76,355 @@ MYSQL_RES *MySQL::query(std::string sql)
 MYSQL *MySQL::getConnection()
 {
     return _conn;
+}
+
+// 开启事务，之后的语句在commit或rollback之前不会自动提交
+bool MySQL::begin()
+{
+    if (mysql_autocommit(_conn, false))
+    {
+        LOG_INFO << __FILE__ << ":" << __LINE__ << ":开启事务失败:" << mysql_error(_conn);
+        return false;
+    }
+    return true;
+}
+
+// 提交事务，恢复自动提交
+bool MySQL::commit()
+{
+    bool ok = !mysql_commit(_conn);
+    if (!ok)
+    {
+        LOG_INFO << __FILE__ << ":" << __LINE__ << ":提交事务失败:" << mysql_error(_conn);
+        rollback();
+        return false;
+    }
+    if (mysql_autocommit(_conn, true))
+    {
+        // 连接停留在事务模式中，不能再归还给其它调用者使用
+        setBroken();
+    }
+    return true;
+}
+
+// 回滚事务，恢复自动提交
+void MySQL::rollback()
+{
+    if (mysql_rollback(_conn) || mysql_autocommit(_conn, true))
+    {
+        setBroken();
+    }
+}
+
+// 检测连接是否可用
+bool MySQL::ping()
+{
+    return mysql_ping(_conn) == 0;
+}
+
+// 连接是否已经与服务器断开（根据最近一次操作的错误码判断）
+bool MySQL::isBroken()
+{
+    unsigned int err = mysql_errno(_conn);
+    return _broken || err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST;
+}
+
+// 刷新连接进入空闲状态的起始时间点
+void MySQL::refreshAliveTime()
+{
+    _alivetime = std::chrono::steady_clock::now();
+}
+
+// 返回连接已经空闲的时长，单位秒
+double MySQL::getIdleTime()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - _alivetime).count();
+}
+
+// 预处理语句，同一条SQL在该连接上只预处理一次，之后复用
+Statement MySQL::prepare(const std::string &sql)
+{
+    auto it = _stmts.find(sql);
+    if (it != _stmts.end())
+    {
+        return Statement(this, it->second);
+    }
+
+    MYSQL_STMT *stmt = mysql_stmt_init(_conn);
+    if (stmt == nullptr)
+    {
+        LOG_INFO << __FILE__ << ":" << __LINE__ << ":" << sql << "预处理失败";
+        return Statement(this, nullptr);
+    }
+
+    if (mysql_stmt_prepare(stmt, sql.c_str(), sql.size()))
+    {
+        LOG_INFO << __FILE__ << ":" << __LINE__ << ":" << sql << "预处理失败:" << mysql_stmt_error(stmt);
+        unsigned int err = mysql_stmt_errno(stmt);
+        if (err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST)
+        {
+            _broken = true;
+        }
+        mysql_stmt_close(stmt);
+        return Statement(this, nullptr);
+    }
+
+    _stmts[sql] = stmt;
+    return Statement(this, stmt);
+}
+
+Statement::Statement(MySQL *mysql, MYSQL_STMT *stmt)
+    : _mysql(mysql), _stmt(stmt)
+{
+    if (_stmt != nullptr)
+    {
+        _params.resize(mysql_stmt_param_count(_stmt));
+        _results.resize(mysql_stmt_field_count(_stmt));
+        for (Param &param : _params)
+        {
+            param.type = MYSQL_TYPE_NULL;
+            param.intValue = 0;
+            param.length = 0;
+        }
+        for (Result &result : _results)
+        {
+            result.intValue = nullptr;
+            result.strValue = nullptr;
+            result.length = 0;
+            result.isNull = 0;
+            result.error = 0;
+        }
+    }
+}
+
+Statement::Statement(Statement &&other)
+    : _mysql(other._mysql),
+      _stmt(other._stmt),
+      _params(std::move(other._params)),
+      _results(std::move(other._results)),
+      _resultBinds(std::move(other._resultBinds))
+{
+    other._stmt = nullptr;
+}
+
+// 释放本次执行的结果集并重置语句，缓存在连接上的语句可以被下一次请求直接使用
+Statement::~Statement()
+{
+    if (_stmt != nullptr)
+    {
+        mysql_stmt_free_result(_stmt);
+        mysql_stmt_reset(_stmt);
+    }
+}
+
+// 绑定第index个参数，从0开始
+void Statement::bindParam(int index, int value)
+{
+    if (index >= 0 && index < static_cast<int>(_params.size()))
+    {
+        _params[index].type = MYSQL_TYPE_LONG;
+        _params[index].intValue = value;
+    }
+}
+
+void Statement::bindParam(int index, const std::string &value)
+{
+    if (index >= 0 && index < static_cast<int>(_params.size()))
+    {
+        _params[index].type = MYSQL_TYPE_STRING;
+        _params[index].strValue = value;
+        _params[index].length = value.size();
+    }
+}
+
+// 把第index个结果列绑定到变量上，每次fetch成功后变量中就是当前行的值，NULL值读出为0或空字符串
+void Statement::bindResult(int index, int *value)
+{
+    if (index >= 0 && index < static_cast<int>(_results.size()))
+    {
+        _results[index].intValue = value;
+    }
+}
+
+void Statement::bindResult(int index, std::string *value)
+{
+    if (index >= 0 && index < static_cast<int>(_results.size()))
+    {
+        _results[index].strValue = value;
+    }
+}
+
+// 执行语句
+bool Statement::execute()
+{
+    if (_stmt == nullptr)
+    {
+        return false;
+    }
+
+    // 参数以二进制方式传给服务器，字符串参数不需要转义，长度也不受SQL缓冲区的限制
+    std::vector<MYSQL_BIND> paramBinds(_params.size());
+    memset(paramBinds.data(), 0, sizeof(MYSQL_BIND) * paramBinds.size());
+    for (size_t i = 0; i < _params.size(); ++i)
+    {
+        Param &param = _params[i];
+        MYSQL_BIND &bind = paramBinds[i];
+        bind.buffer_type = param.type;
+        if (param.type == MYSQL_TYPE_LONG)
+        {
+            bind.buffer = &param.intValue;
+        }
+        else if (param.type == MYSQL_TYPE_STRING)
+        {
+            bind.buffer = const_cast<char *>(param.strValue.data());
+            bind.buffer_length = param.length;
+            bind.length = &param.length;
+        }
+    }
+
+    if (!paramBinds.empty() && mysql_stmt_bind_param(_stmt, paramBinds.data()))
+    {
+        error("bind param");
+        return false;
+    }
+
+    if (mysql_stmt_execute(_stmt))
+    {
+        error("execute");
+        return false;
+    }
+
+    if (_results.empty())
+    {
+        return true;
+    }
+
+    // 整数列直接写入绑定的变量，字符串列先写入接收缓冲区，fetch时再拷贝到绑定的变量
+    _resultBinds.assign(_results.size(), MYSQL_BIND());
+    memset(_resultBinds.data(), 0, sizeof(MYSQL_BIND) * _resultBinds.size());
+    for (size_t i = 0; i < _results.size(); ++i)
+    {
+        Result &result = _results[i];
+        MYSQL_BIND &bind = _resultBinds[i];
+        if (result.intValue != nullptr)
+        {
+            bind.buffer_type = MYSQL_TYPE_LONG;
+            bind.buffer = result.intValue;
+        }
+        else
+        {
+            if (result.buffer.empty())
+            {
+                result.buffer.resize(256);
+            }
+            bind.buffer_type = MYSQL_TYPE_STRING;
+            bind.buffer = result.buffer.data();
+            bind.buffer_length = result.buffer.size();
+            bind.length = &result.length;
+        }
+        bind.is_null = &result.isNull;
+        bind.error = &result.error;
+    }
+
+    if (mysql_stmt_bind_result(_stmt, _resultBinds.data()))
+    {
+        error("bind result");
+        return false;
+    }
+
+    // 把结果集全部读到客户端，连接不会停留在结果未读完的状态
+    if (mysql_stmt_store_result(_stmt))
+    {
+        error("store result");
+        return false;
+    }
+    return true;
+}
+
+// 读取下一行结果，没有更多数据返回false
+bool Statement::fetch()
+{
+    if (_stmt == nullptr || _resultBinds.empty())
+    {
+        return false;
+    }
+
+    int ret = mysql_stmt_fetch(_stmt);
+    if (ret == MYSQL_NO_DATA)
+    {
+        return false;
+    }
+    if (ret == 1)
+    {
+        error("fetch");
+        return false;
+    }
+
+    bool rebind = false;
+    for (size_t i = 0; i < _results.size(); ++i)
+    {
+        Result &result = _results[i];
+        MYSQL_BIND &bind = _resultBinds[i];
+        if (result.intValue != nullptr)
+        {
+            if (result.isNull)
+            {
+                *result.intValue = 0;
+            }
+            continue;
+        }
+
+        if (result.isNull)
+        {
+            result.length = 0;
+        }
+        else if (result.length > result.buffer.size())
+        {
+            // 字符串超过接收缓冲区被截断，扩大缓冲区后单独读取该列，后续行使用新的缓冲区
+            result.buffer.resize(result.length);
+            bind.buffer = result.buffer.data();
+            bind.buffer_length = result.buffer.size();
+            if (mysql_stmt_fetch_column(_stmt, &bind, static_cast<unsigned int>(i), 0))
+            {
+                error("fetch column");
+                return false;
+            }
+            rebind = true;
+        }
+
+        if (result.strValue != nullptr)
+        {
+            result.strValue->assign(result.buffer.data(), result.length);
+        }
+    }
+
+    if (rebind && mysql_stmt_bind_result(_stmt, _resultBinds.data()))
+    {
+        error("bind result");
+        return false;
+    }
+    return true;
+}
+
+// 插入操作生成的自增主键
+my_ulonglong Statement::insertId()
+{
+    return _stmt != nullptr ? mysql_stmt_insert_id(_stmt) : 0;
+}
+
+// 插入、更新、删除操作影响的行数
+my_ulonglong Statement::affectedRows()
+{
+    return _stmt != nullptr ? mysql_stmt_affected_rows(_stmt) : 0;
+}
+
+// 记录执行错误，连接断开时标记连接不可用
+void Statement::error(const char *op)
+{
+    LOG_INFO << __FILE__ << ":" << __LINE__ << ":" << op << "失败:" << mysql_stmt_error(_stmt);
+    unsigned int err = mysql_stmt_errno(_stmt);
+    if (err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST)
+    {
+        _mysql->setBroken();
+    }
 }
\ No newline at end of file
@@ -1,11 +1,12 @@
 #include "chatserver.hpp"
 #include "chatservice.hpp"
+#include "serverconfig.hpp"
 #include <iostream>
 #include <signal.h>
 
 using namespace std;
 
-// 处理服务器ctrl+c结束后，重置user的状态信息
+// 处理服务器ctrl+c结束后，删除本节点用户的在线状态
 void resetHandler(int)
 {
     ChatService::instance()->reset();
@@ -14,24 +15,46 @@ void resetHandler(int)
 
 int main(int argc, char **argv)
 {
-    if (argc < 3)
+    // 解析配置文件和命令行参数，兼容原来的 ip port [worker_threads] 位置参数
+    ServerConfig config;
+    string err;
+    if (!config.parse(argc, argv, err))
     {
-        cerr << "command invalid! example:./ChatServer 127.0.0.1 6000" << endl;
-        exit(-1);
+        if (!err.empty())
+        {
+            cerr << "command invalid! " << err << endl;
+        }
+        ServerConfig::usage(argv[0]);
+        exit(err.empty() ? 0 : -1);
     }
 
-    // 解析通过命令行参数传递的ip和port
-    char *ip = argv[1];
-    uint16_t port = atoi(argv[2]);
-
     signal(SIGINT, resetHandler);
 
     EventLoop loop;
-    InetAddress addr(ip, port);
+    InetAddress addr(config.ip, config.port);
     ChatServer server(&loop, addr, "ChatServer");
 
+    if (config.ioThreads >= 0)
+    {
+        server.setIoThreadNum(config.ioThreads);
+    }
+    if (config.workerThreads >= 0)
+    {
+        server.setWorkerThreadNum(config.workerThreads);
+    }
+    if (!config.nodeId.empty())
+    {
+        server.setNodeId(config.nodeId);
+    }
+    server.setReusePort(config.reusePort);
+    server.setCpuAffinity(config.cpuAffinity);
+
+    // 发给同一连接的消息帧最多等待的时间，以及是否校验跨服务器转发的消息
+    ChatService::instance()->setCorkDelay(config.corkDelayMs / 1000.0);
+    ChatService::instance()->setRelayValidation(config.relayValidate);
+
     server.start();
     loop.loop();
 
     return 0;
-}
\ No newline at end of file
+}
@@ -1,47 +1,44 @@
 #include "friendmodel.hpp"
-#include "db.h"
+#include "connectionpool.h"
 
 // 添加好友关系
 void FriendModel::insert(int user_id, int friend_id)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "insert into Friend values('%d','%d')", user_id, friend_id);
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
     {
-        mysql.update(sql);
+        Statement stmt = mysql->prepare("insert into Friend values(?,?)");
+        stmt.bindParam(0, user_id);
+        stmt.bindParam(1, friend_id);
+        stmt.execute();
     }
 }
 
 // 返回用户好友列表
 vector<User> FriendModel::query(int user_id)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "select a.id,a.name,a.state from User a inner join Friend b on b.friend_id = a.id where b.user_id = %d", user_id);
-
     vector<User> vec;
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        Statement stmt = mysql->prepare("select a.id,a.name from User a inner join Friend b on b.friend_id = a.id where b.user_id = ?");
+        stmt.bindParam(0, user_id);
+
+        int id = -1;
+        string name;
+        stmt.bindResult(0, &id);
+        stmt.bindResult(1, &name);
+        if (stmt.execute())
         {
-            // 把user_id用户的所有离线消息放入vec中返回
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            // 把user_id用户的所有好友放入vec中返回
+            while (stmt.fetch())
             {
                 User user;
-                user.setId(atoi(row[0]));
-                user.setName(row[1]);
-                user.setState(row[2]);
+                user.setId(id);
+                user.setName(name);
                 vec.push_back(user);
             }
-            mysql_free_result(res);
-            return vec;
         }
     }
     return vec;
-}
\ No newline at end of file
+}
@@ -0,0 +1,185 @@
+#include "groupcache.hpp"
+#include <algorithm>
+
+const chrono::seconds GroupCache::kTTL(300);
+
+// 获取单例对象的接口函数
+GroupCache *GroupCache::instance()
+{
+    static GroupCache cache;
+    return &cache;
+}
+
+GroupCache::GroupCache()
+    : _hits(0), _misses(0)
+{
+}
+
+// 查询群组成员，命中返回true
+bool GroupCache::get(int group_id, MemberList &members)
+{
+    Shard &shard = getShard(group_id);
+    {
+        lock_guard<mutex> lock(shard.mtx);
+        auto it = shard.groups.find(group_id);
+        if (it != shard.groups.end())
+        {
+            if (it->second->expire > Clock::now())
+            {
+                // 命中，移动到链表头部；只拷贝智能指针，成员数组在锁外读取
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                members = it->second->members;
+                ++_hits;
+                return true;
+            }
+
+            // 已过期，删除
+            shard.lru.erase(it->second);
+            shard.groups.erase(it);
+        }
+    }
+    ++_misses;
+    return false;
+}
+
+// 群组所在分片的版本号，从数据库加载成员之前获取，写入时用于判断加载期间数据是否被修改过
+uint64_t GroupCache::version(int group_id)
+{
+    Shard &shard = getShard(group_id);
+    lock_guard<mutex> lock(shard.mtx);
+    return shard.version;
+}
+
+// 写入从数据库加载的群组成员，加载期间分片被修改过则放弃写入
+void GroupCache::put(int group_id, vector<int> members, uint64_t version)
+{
+    sort(members.begin(), members.end());
+    members.shrink_to_fit();
+    MemberList list = make_shared<const vector<int>>(std::move(members));
+
+    Shard &shard = getShard(group_id);
+    lock_guard<mutex> lock(shard.mtx);
+    if (shard.version != version)
+    {
+        return;
+    }
+    store(shard, group_id, std::move(list));
+}
+
+// 新创建的群组，成员为空
+void GroupCache::createGroup(int group_id)
+{
+    Shard &shard = getShard(group_id);
+    lock_guard<mutex> lock(shard.mtx);
+    ++shard.version;
+    store(shard, group_id, make_shared<const vector<int>>());
+}
+
+// 群组增加成员，群组不在索引中则忽略，下次查询时从数据库加载
+void GroupCache::addMember(int group_id, int user_id)
+{
+    Shard &shard = getShard(group_id);
+    lock_guard<mutex> lock(shard.mtx);
+    ++shard.version;
+    auto it = shard.groups.find(group_id);
+    if (it == shard.groups.end())
+    {
+        return;
+    }
+
+    // 在副本上有序插入，再替换原数组，正在使用旧数组的群聊不受影响
+    const vector<int> &old = *it->second->members;
+    auto pos = lower_bound(old.begin(), old.end(), user_id);
+    if (pos != old.end() && *pos == user_id)
+    {
+        return;
+    }
+
+    auto members = make_shared<vector<int>>();
+    members->reserve(old.size() + 1);
+    members->insert(members->end(), old.begin(), pos);
+    members->push_back(user_id);
+    members->insert(members->end(), pos, old.end());
+    it->second->members = std::move(members);
+}
+
+// 删除本节点索引中的群组
+void GroupCache::invalidate(int group_id)
+{
+    Shard &shard = getShard(group_id);
+    lock_guard<mutex> lock(shard.mtx);
+    ++shard.version;
+    auto it = shard.groups.find(group_id);
+    if (it != shard.groups.end())
+    {
+        shard.lru.erase(it->second);
+        shard.groups.erase(it);
+    }
+}
+
+// 群组成员被本节点修改，通知其它节点删除索引
+void GroupCache::notifyChanged(int group_id)
+{
+    if (_notifier)
+    {
+        _notifier(group_id);
+    }
+}
+
+// 设置通知其它节点删除索引的回调，由业务层通过redis通道广播
+void GroupCache::setInvalidateNotifier(function<void(int)> notifier)
+{
+    _notifier = notifier;
+}
+
+// 索引中的群组数量
+size_t GroupCache::size()
+{
+    size_t total = 0;
+    for (Shard &shard : _shards)
+    {
+        lock_guard<mutex> lock(shard.mtx);
+        total += shard.groups.size();
+    }
+    return total;
+}
+
+// 索引占用内存的估计值，单位字节：成员数组、数组对象和智能指针控制块、链表节点、哈希表节点
+size_t GroupCache::memoryUsage()
+{
+    size_t total = 0;
+    for (Shard &shard : _shards)
+    {
+        lock_guard<mutex> lock(shard.mtx);
+        total += shard.groups.bucket_count() * sizeof(void *);
+        for (const Entry &entry : shard.lru)
+        {
+            total += entry.members->capacity() * sizeof(int) + sizeof(vector<int>) + 2 * sizeof(long) +
+                     sizeof(Entry) + 2 * sizeof(void *) +
+                     sizeof(pair<const int, list<Entry>::iterator>) + sizeof(void *);
+        }
+    }
+    return total;
+}
+
+// 把群组成员写入分片并移到链表头部，加锁后调用，超过容量时淘汰最久未使用的群组
+void GroupCache::store(Shard &shard, int group_id, MemberList members)
+{
+    Clock::time_point expire = Clock::now() + kTTL;
+    auto it = shard.groups.find(group_id);
+    if (it != shard.groups.end())
+    {
+        it->second->members = std::move(members);
+        it->second->expire = expire;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;
+    }
+
+    shard.lru.push_front({group_id, std::move(members), expire});
+    shard.groups[group_id] = shard.lru.begin();
+    if (shard.lru.size() > kShardCapacity)
+    {
+        shard.groups.erase(shard.lru.back().group_id);
+        shard.lru.pop_back();
+    }
+}
@@ -0,0 +1,277 @@
+#include "groupmessagemodel.hpp"
+#include "connectionpool.h"
+
+// 为群组分配下一条消息的序号，失败返回-1
+int GroupMessageModel::nextSeq(int group_id)
+{
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql == nullptr)
+    {
+        return -1;
+    }
+
+    // 在GroupSeq表中原子地递增群组的序号，LAST_INSERT_ID(expr)把新序号作为本条语句的insert id返回
+    // 并发的消息在同一行上串行递增，每条消息得到不同的序号
+    Statement stmt = mysql->prepare("insert into GroupSeq(group_id,seq) values(?,LAST_INSERT_ID(1)) "
+                                    "on duplicate key update seq = LAST_INSERT_ID(seq + 1)");
+    stmt.bindParam(0, group_id);
+    if (!stmt.execute())
+    {
+        return -1;
+    }
+    return static_cast<int>(stmt.insertId());
+}
+
+// 把分配了序号的群消息写入时间线
+bool GroupMessageModel::insert(int group_id, int seq, const string &msg)
+{
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql == nullptr)
+    {
+        return false;
+    }
+
+    // 消息插入失败时该序号空缺，读取方按序号范围读取，不依赖序号连续
+    Statement stmt = mysql->prepare("insert into GroupMessage(group_id,seq,message) values(?,?,?)");
+    stmt.bindParam(0, group_id);
+    stmt.bindParam(1, seq);
+    stmt.bindParam(2, msg);
+    return stmt.execute();
+}
+
+// 查询用户所有群组的已读位置和最新序号：群组id -> (已读位置, 最新序号)，用户登录时调用
+unordered_map<int, pair<int, int>> GroupMessageModel::querySyncRanges(int user_id)
+{
+    unordered_map<int, pair<int, int>> ranges;
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
+    {
+        Statement stmt = mysql->prepare("select c.group_id,c.seq,ifnull(s.seq,0) from GroupCursor c "
+                                        "left join GroupSeq s on s.group_id = c.group_id where c.user_id = ?");
+        stmt.bindParam(0, user_id);
+
+        int group_id = -1, cursor = 0, latest = 0;
+        stmt.bindResult(0, &group_id);
+        stmt.bindResult(1, &cursor);
+        stmt.bindResult(2, &latest);
+        if (stmt.execute())
+        {
+            while (stmt.fetch())
+            {
+                ranges[group_id] = make_pair(cursor, latest);
+            }
+        }
+    }
+    return ranges;
+}
+
+// 查询用户在群组中的已读位置，没有记录返回0
+int GroupMessageModel::queryCursor(int user_id, int group_id)
+{
+    int cursor = 0;
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
+    {
+        Statement stmt = mysql->prepare("select seq from GroupCursor where user_id = ? and group_id = ?");
+        stmt.bindParam(0, user_id);
+        stmt.bindParam(1, group_id);
+        stmt.bindResult(0, &cursor);
+        if (!stmt.execute() || !stmt.fetch())
+        {
+            cursor = 0;
+        }
+    }
+    return cursor;
+}
+
+// 按序号顺序读取群组中序号在(after, upTo]之间的消息，最多limit条
+vector<GroupMessage> GroupMessageModel::queryRange(int group_id, int after, int upTo, int limit)
+{
+    vector<GroupMessage> vec;
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
+    {
+        Statement stmt = mysql->prepare("select seq,message from GroupMessage "
+                                        "where group_id = ? and seq > ? and seq <= ? order by seq limit ?");
+        stmt.bindParam(0, group_id);
+        stmt.bindParam(1, after);
+        stmt.bindParam(2, upTo);
+        stmt.bindParam(3, limit);
+
+        int seq = 0;
+        string message;
+        stmt.bindResult(0, &seq);
+        stmt.bindResult(1, &message);
+        if (stmt.execute())
+        {
+            while (stmt.fetch())
+            {
+                vec.emplace_back(group_id, seq, message);
+            }
+        }
+    }
+    return vec;
+}
+
+// 一条语句携带的群组数量：不少于剩余群组数的2的幂，最多kMaxGroupsPerStatement，不足的部分用不起作用的条件补齐
+// 预处理语句按sql文本缓存在每个连接上，这样无论用户加入多少群组，每个连接上最多只有几种不同的语句
+static size_t statementSize(size_t remaining, size_t maxSize)
+{
+    size_t count = 1;
+    while (count < remaining && count < maxSize)
+    {
+        count *= 2;
+    }
+    return count;
+}
+
+// 统计多个群组中序号在(after, upTo]之间的消息数量，ranges为群组id -> (after, upTo)，返回群组id -> 数量
+unordered_map<int, int> GroupMessageModel::countRanges(const unordered_map<int, pair<int, int>> &ranges)
+{
+    unordered_map<int, int> counts;
+    if (ranges.empty())
+    {
+        return counts;
+    }
+
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql == nullptr)
+    {
+        return counts;
+    }
+
+    // 每条语句统计一批群组，每个群组一个按主键的范围条件；补齐用的条件序号范围为空，不匹配任何行
+    vector<pair<int, pair<int, int>>> rangeVec(ranges.begin(), ranges.end());
+    for (size_t begin = 0; begin < rangeVec.size();)
+    {
+        size_t count = statementSize(rangeVec.size() - begin, kMaxGroupsPerStatement);
+        string sql = "select group_id,count(*) from GroupMessage where (group_id = ? and seq > ? and seq <= ?)";
+        for (size_t i = 1; i < count; ++i)
+        {
+            sql += " or (group_id = ? and seq > ? and seq <= ?)";
+        }
+        sql += " group by group_id";
+
+        Statement stmt = mysql->prepare(sql);
+        int index = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (begin + i < rangeVec.size())
+            {
+                auto &range = rangeVec[begin + i];
+                stmt.bindParam(index++, range.first);
+                stmt.bindParam(index++, range.second.first);
+                stmt.bindParam(index++, range.second.second);
+            }
+            else
+            {
+                stmt.bindParam(index++, rangeVec[begin].first);
+                stmt.bindParam(index++, 0);
+                stmt.bindParam(index++, 0);
+            }
+        }
+
+        int group_id = -1, rows = 0;
+        stmt.bindResult(0, &group_id);
+        stmt.bindResult(1, &rows);
+        if (stmt.execute())
+        {
+            while (stmt.fetch())
+            {
+                counts[group_id] = rows;
+            }
+        }
+        begin += min(count, rangeVec.size() - begin);
+    }
+    return counts;
+}
+
+// 把用户在多个群组中的已读位置前移，seqs为群组id到序号的映射，已读位置只前移不后退
+void GroupMessageModel::advanceCursors(int user_id, const unordered_map<int, int> &seqs)
+{
+    if (seqs.empty())
+    {
+        return;
+    }
+
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql == nullptr)
+    {
+        return;
+    }
+
+    // 每条语句更新一批群组，已读位置只前移不后退；补齐用的行重复本批第一个群组，重复更新不改变结果
+    vector<pair<int, int>> seqVec(seqs.begin(), seqs.end());
+    for (size_t begin = 0; begin < seqVec.size();)
+    {
+        size_t count = statementSize(seqVec.size() - begin, kMaxGroupsPerStatement);
+        string sql = "insert into GroupCursor(user_id,group_id,seq) values(?,?,?)";
+        for (size_t i = 1; i < count; ++i)
+        {
+            sql += ",(?,?,?)";
+        }
+        sql += " on duplicate key update seq = greatest(GroupCursor.seq, values(seq))";
+
+        Statement stmt = mysql->prepare(sql);
+        int index = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto &seq = seqVec[begin + i < seqVec.size() ? begin + i : begin];
+            stmt.bindParam(index++, user_id);
+            stmt.bindParam(index++, seq.first);
+            stmt.bindParam(index++, seq.second);
+        }
+        stmt.execute();
+        begin += min(count, seqVec.size() - begin);
+    }
+}
+
+// 用户加入群组，已读位置从群组的最新序号开始，不读取加入之前的历史消息
+void GroupMessageModel::initCursor(int user_id, int group_id)
+{
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
+    {
+        Statement stmt = mysql->prepare("insert ignore into GroupCursor(user_id,group_id,seq) "
+                                        "select ?,?,ifnull((select seq from GroupSeq where group_id = ?),0)");
+        stmt.bindParam(0, user_id);
+        stmt.bindParam(1, group_id);
+        stmt.bindParam(2, group_id);
+        stmt.execute();
+    }
+}
+
+// 给用户还没有已读位置的群组（时间线上线之前加入的群组）补上记录，从群组的最新序号开始，用户登录时调用
+void GroupMessageModel::initCursors(int user_id)
+{
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
+    {
+        Statement stmt = mysql->prepare("insert ignore into GroupCursor(user_id,group_id,seq) "
+                                        "select b.user_id,b.group_id,ifnull(s.seq,0) from GroupUser b "
+                                        "left join GroupSeq s on s.group_id = b.group_id where b.user_id = ?");
+        stmt.bindParam(0, user_id);
+        stmt.execute();
+    }
+}
+
+// 删除所有成员的已读位置都已经越过的群消息，返回删除的行数，定期调用
+int GroupMessageModel::prune()
+{
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql == nullptr)
+    {
+        return 0;
+    }
+
+    // 每个群组取成员已读位置的最小值，还没有已读位置的成员按0计算，这样的群组暂不删除
+    Statement stmt = mysql->prepare("delete m from GroupMessage m inner join "
+                                    "(select b.group_id,min(ifnull(c.seq,0)) seq from GroupUser b "
+                                    "left join GroupCursor c on c.user_id = b.user_id and c.group_id = b.group_id "
+                                    "group by b.group_id) k on k.group_id = m.group_id where m.seq <= k.seq");
+    if (!stmt.execute())
+    {
+        return 0;
+    }
+    return static_cast<int>(stmt.affectedRows());
+}
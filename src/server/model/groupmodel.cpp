@@ -1,21 +1,23 @@
 #include "groupmodel.hpp"
-#include "db.h"
+#include "connectionpool.h"
+#include "groupcache.hpp"
 
 // 创建群组
 bool GroupModel::creatGroup(Group &group)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "insert into AllGroup(groupname,groupdesc) values('%s','%s')",
-            group.getName().c_str(), group.getDesc().c_str());
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
     {
-        if (mysql.update(sql))
+        Statement stmt = mysql->prepare("insert into AllGroup(groupname,groupdesc) values(?,?)");
+        stmt.bindParam(0, group.getName());
+        stmt.bindParam(1, group.getDesc());
+        if (stmt.execute())
         {
-            // 获取插入成功的用户数据生成的主键id
-            group.setId(mysql_insert_id(mysql.getConnection()));
+            // 获取插入成功的群组数据生成的主键id
+            group.setId(stmt.insertId());
+
+            // 新群组还没有成员，直接建立索引，不需要再查数据库
+            GroupCache::instance()->createGroup(group.getId());
             return true;
         }
     }
@@ -25,91 +27,112 @@ bool GroupModel::creatGroup(Group &group)
 // 加入群组
 void GroupModel::addGroup(int group_id, int user_id, string role)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "insert into GroupUser values(%d,%d,'%s')",
-            group_id, user_id, role.c_str());
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
     {
-        mysql.update(sql);
+        Statement stmt = mysql->prepare("insert into GroupUser values(?,?,?)");
+        stmt.bindParam(0, group_id);
+        stmt.bindParam(1, user_id);
+        stmt.bindParam(2, role);
+        if (stmt.execute())
+        {
+            // 同步修改本节点的成员索引，并通知其它节点删除索引
+            GroupCache::instance()->addMember(group_id, user_id);
+            GroupCache::instance()->notifyChanged(group_id);
+        }
     }
 }
 
 // 查询用户所在群组信息
 vector<Group> GroupModel::queryGroups(int user_id)
 {
-    // 1.先根据user_id在GroupUser表中查询出该用户所属的群组信息
-    // 2.根据群组信息，查询属于该群组的所有用户的user_id,并且和User表进行多表联合查询，查出用户的详细信息
-    char sql[1024] = {0};
-    sprintf(sql, "select a.id,a.groupname,a.groupdesc from AllGroup a inner join GroupUser b on b.group_id = a.id where b.user_id = %d", user_id);
-
+    // 一条多表联合查询同时查出user_id所属的群组和这些群组的所有成员信息，按群组id排序
+    // 同一个群组的成员行是连续的，边读取边组装Group和GroupUser，避免每个群组再查询一次成员
     vector<Group> groupVec;
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        Statement stmt = mysql->prepare("select a.id,a.groupname,a.groupdesc,u.id,u.name,c.grouprole "
+                                        "from GroupUser b inner join AllGroup a on a.id = b.group_id "
+                                        "inner join GroupUser c on c.group_id = a.id "
+                                        "inner join User u on u.id = c.user_id "
+                                        "where b.user_id = ? order by a.id");
+        stmt.bindParam(0, user_id);
+
+        int group_id = -1, id = -1;
+        string groupname, groupdesc, name, role;
+        stmt.bindResult(0, &group_id);
+        stmt.bindResult(1, &groupname);
+        stmt.bindResult(2, &groupdesc);
+        stmt.bindResult(3, &id);
+        stmt.bindResult(4, &name);
+        stmt.bindResult(5, &role);
+        if (stmt.execute())
         {
-            // 查出user_id所有的群组信息
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            while (stmt.fetch())
             {
-                Group group;
-                group.setId(atoi(row[0]));
-                group.setName(row[1]);
-                group.setDesc(row[2]);
-                groupVec.push_back(group);
+                // 遇到新的群组id，开始组装下一个群组
+                if (groupVec.empty() || groupVec.back().getId() != group_id)
+                {
+                    groupVec.emplace_back(group_id, groupname, groupdesc);
+                }
+
+                GroupUser user;
+                user.setId(id);
+                user.setName(name);
+                user.setRole(role);
+                groupVec.back().getGroupUser().push_back(user);
             }
-            mysql_free_result(res);
         }
     }
+    return groupVec;
+}
 
-    // 查询群组的用户信息
-    for (Group &group : groupVec)
+// 根据指定的group_id查询群组用户id列表，除user_id自己，主要用户群聊业务给群组其它成员群发消息
+vector<int> GroupModel::queryGroupUsers(int user_id, int group_id)
+{
+    // 先查成员索引，未命中则从数据库加载整个群组的成员并建立索引
+    GroupCache::MemberList members;
+    if (!GroupCache::instance()->get(group_id, members))
     {
-        sprintf(sql, "select a.id,a.name,a.state,b.grouprole from User a inner join GroupUser b on b.user_id = a.id where b.group_id = %d", group.getId());
+        members = make_shared<const vector<int>>(loadGroupUsers(group_id));
+    }
 
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+    vector<int> idVec;
+    idVec.reserve(members->size());
+    for (int id : *members)
+    {
+        if (id != user_id)
         {
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
-            {
-                GroupUser user;
-                user.setId(atoi(row[0]));
-                user.setName(row[1]);
-                user.setState(row[2]);
-                user.setRole(row[3]);
-                group.getGroupUser().push_back(user);
-            }
-            mysql_free_result(res);
+            idVec.push_back(id);
         }
     }
-    return groupVec;
+    return idVec;
 }
 
-// 根据指定的group_id查询群组用户id列表，除user_id自己，主要用户群聊业务给群组其它成员群发消息
-vector<int> GroupModel::queryGroupUsers(int user_id, int group_id)
+// 从数据库加载群组的所有成员，并写入成员索引
+vector<int> GroupModel::loadGroupUsers(int group_id)
 {
-    char sql[1024] = {0};
-    sprintf(sql, "select user_id from GroupUser where group_id = %d and user_id != %d", group_id, user_id);
+    // 加载之前记录索引的版本，加载期间成员被修改过则不写入索引，避免覆盖较新的数据
+    uint64_t version = GroupCache::instance()->version(group_id);
 
     vector<int> idVec;
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        Statement stmt = mysql->prepare("select user_id from GroupUser where group_id = ?");
+        stmt.bindParam(0, group_id);
+
+        int id = -1;
+        stmt.bindResult(0, &id);
+        if (stmt.execute())
         {
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            while (stmt.fetch())
             {
-                idVec.push_back(atoi(row[0]));
+                idVec.push_back(id);
             }
-            mysql_free_result(res);
+            GroupCache::instance()->put(group_id, idVec, version);
         }
     }
     return idVec;
-}
\ No newline at end of file
+}
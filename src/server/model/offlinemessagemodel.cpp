@@ -1,57 +1,61 @@
 #include "offlinemessagemodel.hpp"
-#include "db.h"
+#include "connectionpool.h"
+#include "offlinemsgbatcher.hpp"
 
-// 存取用户的离线消息
+// 存取用户的离线消息，先放入写入队列，由OfflineMsgBatcher批量写入数据库
 void OfflineMsgModel::insert(int user_id, std::string msg)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "insert into OfflineMessage values('%d','%s')", user_id, msg.c_str());
+    OfflineMsgBatcher::instance()->add({user_id}, msg);
+}
 
-    MySQL mysql;
-    if (mysql.connect())
-    {
-        mysql.update(sql);
-    }
+// 给多个用户存储同一条离线消息，多个用户共享同一份消息内容
+void OfflineMsgModel::insert(const std::vector<int> &user_ids, const std::string &msg)
+{
+    OfflineMsgBatcher::instance()->add(user_ids, msg);
 }
 
-// 删除用户的离线消息
-void OfflineMsgModel::remove(int user_id)
+// 等待之前存储的离线消息全部写入数据库，读取离线消息之前调用
+bool OfflineMsgModel::flush()
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "delete from OfflineMessage where user_id = %d ", user_id);
+    return OfflineMsgBatcher::instance()->flush();
+}
 
-    MySQL mysql;
-    if (mysql.connect())
+// 删除用户id不大于max_id的离线消息，客户端确认收到之后调用
+void OfflineMsgModel::remove(int user_id, int max_id)
+{
+    std::shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
     {
-        mysql.update(sql);
+        Statement stmt = mysql->prepare("delete from OfflineMessage where user_id = ? and id <= ?");
+        stmt.bindParam(0, user_id);
+        stmt.bindParam(1, max_id);
+        stmt.execute();
     }
 }
 
-// 查询用户的离线消息
-std::vector<std::string> OfflineMsgModel::query(int user_id)
+// 分页查询用户id大于after_id的离线消息，最多limit条，按id排序，返回消息id和消息内容
+std::vector<std::pair<int, std::string>> OfflineMsgModel::query(int user_id, int after_id, int limit)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "select message from OfflineMessage where user_id = %d", user_id);
-
-    std::vector<std::string> vec;
-    MySQL mysql;
-    if (mysql.connect())
+    std::vector<std::pair<int, std::string>> vec;
+    std::shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        Statement stmt = mysql->prepare("select id,message from OfflineMessage where user_id = ? and id > ? order by id limit ?");
+        stmt.bindParam(0, user_id);
+        stmt.bindParam(1, after_id);
+        stmt.bindParam(2, limit);
+
+        int id = 0;
+        std::string message;
+        stmt.bindResult(0, &id);
+        stmt.bindResult(1, &message);
+        if (stmt.execute())
         {
-            // 把user_id用户的所有离线消息放入vec中返回
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            while (stmt.fetch())
             {
-                vec.push_back(row[0]);
+                vec.emplace_back(id, message);
             }
-            mysql_free_result(res);
-            return vec;
         }
     }
     return vec;
-}
\ No newline at end of file
+}
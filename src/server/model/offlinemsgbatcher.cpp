@@ -0,0 +1,250 @@
+#include "offlinemsgbatcher.hpp"
+#include <muduo/base/Logging.h>
+#include <algorithm>
+#include <iterator>
+
+const chrono::milliseconds OfflineMsgBatcher::kFlushInterval(20);
+const chrono::milliseconds OfflineMsgBatcher::kFlushTimeout(3000);
+const chrono::milliseconds OfflineMsgBatcher::kRetryInterval(200);
+
+// 获取单例对象的接口函数
+OfflineMsgBatcher *OfflineMsgBatcher::instance()
+{
+    static OfflineMsgBatcher batcher;
+    return &batcher;
+}
+
+OfflineMsgBatcher::OfflineMsgBatcher()
+    : _enqueued(0), _processed(0), _written(0), _dropped(0), _flushWaiters(0), _quit(false)
+{
+    // 先构造连接池，保证程序退出时连接池在写入器之后析构，写入器析构时还能写入剩余的消息
+    ConnectionPool::instance();
+    _writeThread = thread(std::bind(&OfflineMsgBatcher::writeTask, this));
+}
+
+// 退出前把队列中剩余的消息写入数据库
+OfflineMsgBatcher::~OfflineMsgBatcher()
+{
+    {
+        lock_guard<mutex> lock(_queueMutex);
+        _quit = true;
+    }
+    _writeCv.notify_one();
+    if (_writeThread.joinable())
+    {
+        _writeThread.join();
+    }
+}
+
+// 给多个用户存储同一条离线消息，多个用户共享同一份消息内容
+void OfflineMsgBatcher::add(const vector<int> &user_ids, const string &msg)
+{
+    if (user_ids.empty())
+    {
+        return;
+    }
+
+    auto shared = make_shared<const string>(msg);
+    bool full = false;
+    {
+        lock_guard<mutex> lock(_queueMutex);
+        if (_queue.empty())
+        {
+            _firstTime = chrono::steady_clock::now();
+        }
+        for (int id : user_ids)
+        {
+            _queue.push_back({id, shared});
+        }
+        _enqueued += user_ids.size();
+        full = _queue.size() >= kMaxBatchSize;
+    }
+
+    // 队列为空时写入线程按时间阈值等待，这里只在达到数量阈值时唤醒它
+    if (full)
+    {
+        _writeCv.notify_one();
+    }
+}
+
+// 写入屏障：等待调用之前放入队列的消息全部处理完成，超时或等待期间有消息写入失败被丢弃时返回false
+bool OfflineMsgBatcher::flush()
+{
+    unique_lock<mutex> lock(_queueMutex);
+    uint64_t target = _enqueued;
+    if (_processed >= target)
+    {
+        return true;
+    }
+
+    uint64_t dropped = _dropped;
+    ++_flushWaiters;
+    _writeCv.notify_one();
+    bool done = _flushCv.wait_for(lock, kFlushTimeout, [this, target]()
+                                  { return _processed >= target; });
+    --_flushWaiters;
+    if (!done)
+    {
+        LOG_ERROR << "flush offline messages timeout!";
+    }
+    return done && _dropped == dropped;
+}
+
+// 队列中等待写入的消息数量
+size_t OfflineMsgBatcher::pending()
+{
+    lock_guard<mutex> lock(_queueMutex);
+    return _queue.size();
+}
+
+// 成功写入数据库的消息数量
+uint64_t OfflineMsgBatcher::written()
+{
+    lock_guard<mutex> lock(_queueMutex);
+    return _written;
+}
+
+// 写入失败被丢弃的消息数量
+uint64_t OfflineMsgBatcher::dropped()
+{
+    lock_guard<mutex> lock(_queueMutex);
+    return _dropped;
+}
+
+// 写入线程的主循环
+void OfflineMsgBatcher::writeTask()
+{
+    vector<Row> rows;
+    while (true)
+    {
+        {
+            unique_lock<mutex> lock(_queueMutex);
+            _writeCv.wait(lock, [this]()
+                          { return _quit || !_queue.empty(); });
+
+            // 没有达到数量阈值且没有线程等待写入屏障时，等到最早的消息满kFlushInterval再写入，积累更多的消息
+            _writeCv.wait_until(lock, _firstTime + kFlushInterval, [this]()
+                                { return _quit || _flushWaiters > 0 || _queue.size() >= kMaxBatchSize; });
+
+            if (_queue.empty() && _quit)
+            {
+                break;
+            }
+            rows.swap(_queue);
+        }
+
+        // 在锁外写入数据库，写入期间其它线程可以继续放入消息
+        vector<Row> retry;
+        size_t dropped = writeRange(rows, 0, rows.size(), retry);
+
+        {
+            unique_lock<mutex> lock(_queueMutex);
+            if (!retry.empty() && _quit)
+            {
+                // 退出时数据库仍然不可用，不再等待
+                for (const Row &row : retry)
+                {
+                    LOG_ERROR << "drop offline message of user " << row.user_id << ", " << row.msg->size() << " bytes";
+                }
+                dropped += retry.size();
+                retry.clear();
+            }
+
+            _processed += rows.size() - retry.size();
+            _written += rows.size() - retry.size() - dropped;
+            _dropped += dropped;
+
+            if (!retry.empty())
+            {
+                // 取不到连接的消息放回队列头部，保持原来的顺序，等待kRetryInterval后再写入
+                // 等待写入屏障的线程在超时后得到false，由客户端稍后重试同步
+                LOG_ERROR << "no mysql connection, requeue " << retry.size() << " offline messages";
+                if (_queue.empty())
+                {
+                    _firstTime = chrono::steady_clock::now();
+                }
+                _queue.insert(_queue.begin(), make_move_iterator(retry.begin()), make_move_iterator(retry.end()));
+                _writeCv.wait_for(lock, kRetryInterval, [this]()
+                                  { return _quit; });
+            }
+        }
+        _flushCv.notify_all();
+        rows.clear();
+    }
+}
+
+// 写入rows[begin, end)，整批失败时二分后分别写入，只丢弃无法写入的行，返回丢弃的行数
+// 取不到连接时数据本身没有问题，这些行放入retry稍后重新写入，不丢弃
+size_t OfflineMsgBatcher::writeRange(const vector<Row> &rows, size_t begin, size_t end, vector<Row> &retry)
+{
+    // 连接断开等错误换一个连接重试一次
+    bool noConnection = false;
+    if (write(rows, begin, end, noConnection) || write(rows, begin, end, noConnection))
+    {
+        return 0;
+    }
+
+    // 取不到连接时拆分也无法写入，稍后重试
+    if (noConnection)
+    {
+        retry.insert(retry.end(), rows.begin() + begin, rows.begin() + end);
+        return 0;
+    }
+
+    // 只剩一行时这一行本身无法写入
+    if (end - begin == 1)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            LOG_ERROR << "drop offline message of user " << rows[i].user_id << ", " << rows[i].msg->size() << " bytes";
+        }
+        return end - begin;
+    }
+
+    // 一行错误的数据会使整个事务失败，二分后分别写入，其它行不受影响
+    size_t mid = begin + (end - begin) / 2;
+    return writeRange(rows, begin, mid, retry) + writeRange(rows, mid, end, retry);
+}
+
+// 在一个事务中写入rows[begin, end)，每条INSERT语句携带多行
+bool OfflineMsgBatcher::write(const vector<Row> &rows, size_t begin, size_t end, bool &noConnection)
+{
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql == nullptr || !mysql->begin())
+    {
+        noConnection = true;
+        return false;
+    }
+    noConnection = false;
+
+    while (begin < end)
+    {
+        // 每条语句的行数取不超过剩余行数的2的幂，同一个连接上最多只有几种不同的语句需要预处理
+        size_t count = kMaxRowsPerStatement;
+        while (count > end - begin)
+        {
+            count /= 2;
+        }
+
+        string sql = "insert into OfflineMessage(user_id,message) values(?,?)";
+        for (size_t i = 1; i < count; ++i)
+        {
+            sql += ",(?,?)";
+        }
+
+        Statement stmt = mysql->prepare(sql);
+        for (size_t i = 0; i < count; ++i)
+        {
+            stmt.bindParam(static_cast<int>(2 * i), rows[begin + i].user_id);
+            stmt.bindParam(static_cast<int>(2 * i + 1), *rows[begin + i].msg);
+        }
+        if (!stmt.execute())
+        {
+            mysql->rollback();
+            return false;
+        }
+        begin += count;
+    }
+
+    return mysql->commit();
+}
@@ -0,0 +1,312 @@
+#include "presencemodel.hpp"
+#include <muduo/base/Logging.h>
+#include <chrono>
+#include <future>
+#include <memory>
+
+// 记录用户所在节点的hash表：field为用户id，value为节点id
+static const string kPresenceKey = "chat:presence";
+// 记录节点租约的hash表：field为节点id，value为租约到期的时间（redis服务器时间，毫秒），租约未到期说明节点存活
+static const string kLeasesKey = "chat:leases";
+// 记录节点上在线用户的set的key前缀
+static const string kNodeUsersPrefix = "chat:presence:";
+
+// 同步等待redis结果的超时时间
+static const chrono::milliseconds kQueryTimeout(1000);
+
+// 脚本中读取redis服务器的当前时间，单位毫秒，所有节点都以redis的时钟判断租约是否到期
+// 读取时间后还要写入的脚本需要先调用replicate_commands，按命令而不是按脚本复制
+static const string kLuaNow = "local t = redis.call('time') local now = t[1] * 1000 + math.floor(t[2] / 1000) ";
+
+// 上线：用户记录的节点租约仍然存活则返回0；否则记录用户所在的节点，返回1
+// KEYS[1]:presence表 KEYS[2]:节点用户set KEYS[3]:租约表 ARGV[1]:用户id ARGV[2]:节点id
+static const string kOnlineScript =
+    "redis.replicate_commands() " + kLuaNow +
+    "local cur = redis.call('hget', KEYS[1], ARGV[1]) "
+    "if cur then "
+    "local lease = tonumber(redis.call('hget', KEYS[3], cur)) "
+    "if lease and lease > now then return 0 end "
+    "end "
+    "redis.call('hset', KEYS[1], ARGV[1], ARGV[2]) "
+    "redis.call('sadd', KEYS[2], ARGV[1]) "
+    "return 1";
+
+// 下线：仅当用户记录的节点与参数一致时才删除
+// KEYS[1]:presence表 KEYS[2]:节点用户set ARGV[1]:用户id ARGV[2]:节点id
+static const string kOfflineScript =
+    "if redis.call('hget', KEYS[1], ARGV[1]) == ARGV[2] then "
+    "redis.call('hdel', KEYS[1], ARGV[1]) end "
+    "redis.call('srem', KEYS[2], ARGV[1]) "
+    "return 1";
+
+// 查询：返回与ARGV一一对应的节点id，没有记录或节点租约已经到期的用户为空字符串，脚本只读
+// KEYS[1]:presence表 KEYS[2]:租约表 ARGV:用户id
+static const string kQueryScript =
+    kLuaNow +
+    "local nodes = redis.call('hmget', KEYS[1], unpack(ARGV)) "
+    "local alive = {} "
+    "for i, node in ipairs(nodes) do "
+    "if node then "
+    "if alive[node] == nil then "
+    "local lease = tonumber(redis.call('hget', KEYS[2], node)) "
+    "alive[node] = lease ~= nil and lease > now "
+    "end "
+    "if not alive[node] then nodes[i] = '' end "
+    "else nodes[i] = '' end "
+    "end "
+    "return nodes";
+
+// 续约：把节点的租约延长到当前时间之后ARGV[2]毫秒
+// KEYS[1]:租约表 ARGV[1]:节点id ARGV[2]:租约有效时间
+static const string kRefreshScript =
+    "redis.replicate_commands() " + kLuaNow +
+    "redis.call('hset', KEYS[1], ARGV[1], now + tonumber(ARGV[2])) "
+    "return 1";
+
+// 查找租约已经到期的节点，脚本只读
+// KEYS[1]:租约表
+static const string kExpiredScript =
+    kLuaNow +
+    "local leases = redis.call('hgetall', KEYS[1]) "
+    "local expired = {} "
+    "for i = 1, #leases, 2 do "
+    "if tonumber(leases[i + 1]) <= now then expired[#expired + 1] = leases[i] end "
+    "end "
+    "return expired";
+
+// 清理节点：删除节点上所有用户的在线记录、节点用户set和租约，返回删除的用户数
+// ARGV[2]为1时只清理租约已经到期的节点，节点在查找之后重新续约则返回-1
+// KEYS[1]:presence表 KEYS[2]:节点用户set KEYS[3]:租约表 ARGV[1]:节点id ARGV[2]:是否只清理到期的节点
+static const string kClearNodeScript =
+    "redis.replicate_commands() " + kLuaNow +
+    "if ARGV[2] == '1' then "
+    "local lease = tonumber(redis.call('hget', KEYS[3], ARGV[1])) "
+    "if lease and lease > now then return -1 end "
+    "end "
+    "local users = redis.call('smembers', KEYS[2]) "
+    "for _, id in ipairs(users) do "
+    "if redis.call('hget', KEYS[1], id) == ARGV[1] then redis.call('hdel', KEYS[1], id) end "
+    "end "
+    "redis.call('del', KEYS[2]) "
+    "redis.call('hdel', KEYS[3], ARGV[1]) "
+    "return #users";
+
+PresenceModel::PresenceModel(Redis *redis)
+    : _redis(redis)
+{
+}
+
+// 一次上线请求的状态，在调用线程和redis线程之间共享
+struct PresenceModel::OnlineTask
+{
+    enum
+    {
+        PENDING,   // 等待结果
+        DONE,      // 结果已经交给调用线程
+        ABANDONED, // 调用线程已经超时返回
+    };
+
+    int user_id;
+    string node;
+    atomic<int> state{PENDING};
+    promise<OnlineResult> result;
+
+    // 把结果交给调用线程，调用线程已经超时返回时返回false
+    bool finish(OnlineResult online)
+    {
+        int expected = PENDING;
+        if (!state.compare_exchange_strong(expected, DONE))
+        {
+            return false;
+        }
+        result.set_value(online);
+        return true;
+    }
+};
+
+// 用户在node上线，用户已经在其它存活的节点（包括本节点）上线时返回ONLINE_ALREADY
+PresenceModel::OnlineResult PresenceModel::setOnline(int user_id, const string &node)
+{
+    // 上线的结果决定登录是否成功，需要同步等待
+    auto task = make_shared<OnlineTask>();
+    task->user_id = user_id;
+    task->node = node;
+    future<OnlineResult> online = task->result.get_future();
+
+    bool sent = _redis->command({"EVAL", kOnlineScript, "3", kPresenceKey, kNodeUsersPrefix + node, kLeasesKey,
+                                 to_string(user_id), node},
+                                [this, task](redisReply *reply)
+                                {
+        if (reply == nullptr || reply->type != REDIS_REPLY_INTEGER)
+        {
+            task->finish(ONLINE_ERROR);
+        }
+        else if (reply->integer == 1)
+        {
+            // 调用线程已经超时返回，登录失败，撤销这次上线
+            if (!task->finish(ONLINE_OK))
+            {
+                setOffline(task->user_id, task->node);
+            }
+        }
+        else
+        {
+            task->finish(ONLINE_ALREADY);
+        } });
+    if (!sent)
+    {
+        return ONLINE_ERROR;
+    }
+
+    if (online.wait_for(kQueryTimeout) != future_status::ready)
+    {
+        // 超时后脚本仍可能执行成功，由redis线程在收到成功结果时撤销这次上线，用户不会被锁在外面
+        int expected = OnlineTask::PENDING;
+        if (task->state.compare_exchange_strong(expected, OnlineTask::ABANDONED))
+        {
+            LOG_ERROR << "set presence of user " << user_id << " timeout!";
+            return ONLINE_ERROR;
+        }
+    }
+    return online.get();
+}
+
+// 用户从node下线，仅当用户记录的节点是node时才删除，避免删掉用户在其它节点上的新登录
+void PresenceModel::setOffline(int user_id, const string &node)
+{
+    _redis->command({"EVAL", kOfflineScript, "2", kPresenceKey, kNodeUsersPrefix + node, to_string(user_id), node},
+                    [user_id](redisReply *reply)
+                    {
+        if (reply == nullptr || reply->type == REDIS_REPLY_ERROR)
+        {
+            LOG_ERROR << "remove presence of user " << user_id << " failed!";
+        } });
+}
+
+// 批量查询用户所在的节点，返回值与ids一一对应，不在线的用户为空字符串
+vector<string> PresenceModel::query(const vector<int> &ids)
+{
+    if (ids.empty())
+    {
+        return vector<string>();
+    }
+
+    // 每kMaxBatchSize个用户一条EVAL，各条命令在同一个连接上流水线发送，
+    // 回调都在redis线程中依次执行，最后一条完成时通知调用线程
+    struct Batch
+    {
+        vector<string> nodes;
+        size_t remaining;
+        bool failed = false;
+        promise<void> done;
+    };
+    auto batch = make_shared<Batch>();
+    batch->nodes.resize(ids.size());
+    batch->remaining = (ids.size() + kMaxBatchSize - 1) / kMaxBatchSize;
+    future<void> done = batch->done.get_future();
+
+    for (size_t begin = 0; begin < ids.size(); begin += kMaxBatchSize)
+    {
+        size_t end = min(ids.size(), begin + kMaxBatchSize);
+        vector<string> argv{"EVAL", kQueryScript, "2", kPresenceKey, kLeasesKey};
+        argv.reserve(5 + end - begin);
+        for (size_t i = begin; i < end; ++i)
+        {
+            argv.push_back(to_string(ids[i]));
+        }
+
+        bool sent = _redis->command(std::move(argv), [batch, begin, end](redisReply *reply)
+                                    {
+            if (reply != nullptr && reply->type == REDIS_REPLY_ARRAY && reply->elements == end - begin)
+            {
+                for (size_t i = 0; i < reply->elements; ++i)
+                {
+                    redisReply *elem = reply->element[i];
+                    if (elem->type == REDIS_REPLY_STRING)
+                    {
+                        batch->nodes[begin + i].assign(elem->str, elem->len);
+                    }
+                }
+            }
+            else
+            {
+                batch->failed = true;
+            }
+            if (--batch->remaining == 0)
+            {
+                batch->done.set_value();
+            } });
+        if (!sent)
+        {
+            return vector<string>(ids.size());
+        }
+    }
+
+    if (done.wait_for(kQueryTimeout) != future_status::ready)
+    {
+        LOG_ERROR << "query presence of " << ids.size() << " users timeout!";
+        return vector<string>(ids.size());
+    }
+    if (batch->failed)
+    {
+        return vector<string>(ids.size());
+    }
+    return std::move(batch->nodes);
+}
+
+// 续约node的租约
+void PresenceModel::refreshLease(const string &node)
+{
+    _redis->command({"EVAL", kRefreshScript, "1", kLeasesKey, node, to_string(kLeaseTTL)}, [node](redisReply *reply)
+                    {
+        if (reply == nullptr || reply->type == REDIS_REPLY_ERROR)
+        {
+            LOG_ERROR << "refresh presence lease of node " << node << " failed!";
+        } });
+}
+
+// 删除租约已经到期的节点上所有用户的在线记录，不等待结果
+void PresenceModel::reapExpiredNodes()
+{
+    // 先查出到期的节点，再逐个清理；清理脚本会再检查一次租约，查找之后重新续约的节点不会被清理
+    _redis->command({"EVAL", kExpiredScript, "1", kLeasesKey}, [this](redisReply *reply)
+                    {
+        if (reply == nullptr || reply->type != REDIS_REPLY_ARRAY)
+        {
+            LOG_ERROR << "find expired presence leases failed!";
+            return;
+        }
+        for (size_t i = 0; i < reply->elements; ++i)
+        {
+            string node(reply->element[i]->str, reply->element[i]->len);
+            _redis->command({"EVAL", kClearNodeScript, "3", kPresenceKey, kNodeUsersPrefix + node, kLeasesKey, node, "1"},
+                            [node](redisReply *reply)
+                            {
+                if (reply != nullptr && reply->type == REDIS_REPLY_INTEGER && reply->integer >= 0)
+                {
+                    LOG_INFO << "presence lease of node " << node << " expired, " << reply->integer << " users offline";
+                } });
+        } });
+}
+
+// 删除node上所有用户的在线记录和node的租约，服务器启动和退出时调用
+bool PresenceModel::clearNode(const string &node)
+{
+    // 服务器退出前调用，必须等待命令执行完成
+    auto result = make_shared<promise<bool>>();
+    future<bool> cleared = result->get_future();
+    bool sent = _redis->command({"EVAL", kClearNodeScript, "3", kPresenceKey, kNodeUsersPrefix + node, kLeasesKey, node, "0"},
+                                [result](redisReply *reply)
+                                { result->set_value(reply != nullptr && reply->type == REDIS_REPLY_INTEGER); });
+    if (!sent)
+    {
+        return false;
+    }
+
+    if (cleared.wait_for(kQueryTimeout) != future_status::ready)
+    {
+        LOG_ERROR << "clear presence of node " << node << " timeout!";
+        return false;
+    }
+    return cleared.get();
+}
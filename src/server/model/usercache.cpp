@@ -0,0 +1,121 @@
+#include "usercache.hpp"
+
+const std::chrono::seconds UserCache::kTTL(60);
+
+// 获取单例对象的接口函数
+UserCache *UserCache::instance()
+{
+    static UserCache cache;
+    return &cache;
+}
+
+UserCache::UserCache()
+    : _hits(0), _misses(0)
+{
+}
+
+// 查询缓存，命中返回true
+bool UserCache::get(int id, User &user)
+{
+    Shard &shard = getShard(id);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(id);
+        if (it != shard.index.end())
+        {
+            if (it->second->expire > Clock::now())
+            {
+                // 命中，移动到链表头部
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                user = it->second->user;
+                ++_hits;
+                return true;
+            }
+
+            // 已过期，删除
+            shard.lru.erase(it->second);
+            shard.index.erase(it);
+        }
+    }
+    ++_misses;
+    return false;
+}
+
+// 用户所在分片的失效代数，查询数据库之前读取，写回缓存时传给put
+uint64_t UserCache::generation(int id)
+{
+    Shard &shard = getShard(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.generation;
+}
+
+// 写入缓存，超过容量时淘汰最久未使用的数据
+// 读取generation之后分片中有数据被删除时放弃写入，避免查到的旧数据覆盖更新的失效
+void UserCache::put(User user, uint64_t generation)
+{
+    int id = user.getId();
+    Shard &shard = getShard(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.generation != generation)
+    {
+        return;
+    }
+    auto it = shard.index.find(id);
+    if (it != shard.index.end())
+    {
+        it->second->user = user;
+        it->second->expire = Clock::now() + kTTL;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;
+    }
+
+    shard.lru.push_front({user, Clock::now() + kTTL});
+    shard.index[id] = shard.lru.begin();
+    if (shard.lru.size() > kShardCapacity)
+    {
+        shard.index.erase(shard.lru.back().user.getId());
+        shard.lru.pop_back();
+    }
+}
+
+// 删除本节点缓存中的用户
+void UserCache::invalidate(int id)
+{
+    Shard &shard = getShard(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    ++shard.generation;
+    auto it = shard.index.find(id);
+    if (it != shard.index.end())
+    {
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+}
+
+// 用户数据被本节点修改：删除本节点的缓存，并通知其它节点删除
+void UserCache::changed(int id)
+{
+    invalidate(id);
+    if (_notifier)
+    {
+        _notifier(id);
+    }
+}
+
+// 设置通知其它节点删除缓存的回调，由业务层通过redis通道广播
+void UserCache::setInvalidateNotifier(std::function<void(int)> notifier)
+{
+    _notifier = notifier;
+}
+
+// 缓存中的用户数量
+size_t UserCache::size()
+{
+    size_t total = 0;
+    for (Shard &shard : _shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.index.size();
+    }
+    return total;
+}
@@ -1,88 +1,65 @@
 #include "usermodel.hpp"
-#include "db.h"
+#include "connectionpool.h"
+#include "usercache.hpp"
 #include <iostream>
 using namespace std;
 
 // User表的增加方法
 bool UserModel::insert(User &user)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "insert into User(name,password,state) values('%s','%s','%s')",
-            user.getName().c_str(), user.getPwd().c_str(), user.getState().c_str());
-
-    MySQL mysql;
-    if (mysql.connect())
+    // 1.预处理sql语句，参数以二进制方式绑定
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
     {
-        if (mysql.update(sql))
+        Statement stmt = mysql->prepare("insert into User(name,password,state) values(?,?,?)");
+        stmt.bindParam(0, user.getName());
+        stmt.bindParam(1, user.getPwd());
+        stmt.bindParam(2, user.getState());
+        if (stmt.execute())
         {
             // 获取插入成功的用户数据生成的主键id
-            user.setId(mysql_insert_id(mysql.getConnection()));
+            user.setId(stmt.insertId());
+
+            // 新id不应命中旧的缓存数据，其它节点上同样失效
+            UserCache::instance()->changed(user.getId());
             return true;
         }
     }
     return false;
 }
 
-// 根据用户号码查询用户信息
+// 根据用户号码查询用户信息，返回的用户不带在线状态
 User UserModel::query(int id)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "select * from User where id = %d", id);
-
-    MySQL mysql;
-    if (mysql.connect())
+    // 先查进程内缓存，命中则不需要访问数据库
+    User user;
+    UserCache *cache = UserCache::instance();
+    if (cache->get(id, user))
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
-        {
-            // 从资源上获取行内容
-            MYSQL_ROW row = mysql_fetch_row(res);
-            if (row != nullptr)
-            {
-                User user;
-                user.setId(atoi(row[0]));
-                user.setName(row[1]);
-                user.setPwd(row[2]);
-                user.setState(row[3]);
-
-                mysql_free_result(res);
-
-                return user;
-            }
-        }
+        return user;
     }
-    return User(); // 返回-1
-}
 
-// 更新用户的状态信息
-bool UserModel::updateState(User user)
-{
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "update User set state = '%s' where id = '%d'", user.getState().c_str(), user.getId());
+    // 在查询数据库之前取得失效代数，查询期间缓存被失效则不写回
+    uint64_t generation = cache->generation(id);
 
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
     {
-        if (mysql.update(sql))
+        Statement stmt = mysql->prepare("select id,name,password from User where id = ?");
+        stmt.bindParam(0, id);
+
+        // 结果列直接绑定到变量上
+        int userId = -1;
+        string name, password;
+        stmt.bindResult(0, &userId);
+        stmt.bindResult(1, &name);
+        stmt.bindResult(2, &password);
+        if (stmt.execute() && stmt.fetch())
         {
-            return true;
+            user = User(userId, name, password);
+            cache->put(user, generation);
+            return user;
         }
     }
-    return false;
+    return User(); // 返回-1
 }
-
-// 重置用户的状态信息
-void UserModel::resetState()
-{
-    // 1.组装sql语句
-    char sql[1024] = "update User set state = 'offline' where state = 'online'";
-
-    MySQL mysql;
-    if (mysql.connect())
-    {
-        mysql.update(sql);
-    }
-}
\ No newline at end of file
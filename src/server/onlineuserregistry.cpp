@@ -0,0 +1,92 @@
+#include "onlineuserregistry.hpp"
+
+// 查找用户的连接，用户不在本服务器上返回nullptr
+TcpConnectionPtr OnlineUserRegistry::find(int id)
+{
+    Shard &shard = _shards[shardIndex(id)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.conns.find(id);
+    if (it != shard.conns.end())
+    {
+        return it->second;
+    }
+    return TcpConnectionPtr();
+}
+
+// 记录用户的连接，已存在则覆盖
+void OnlineUserRegistry::insert(int id, const TcpConnectionPtr &conn)
+{
+    Shard &shard = _shards[shardIndex(id)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.conns[id] = conn;
+}
+
+// 删除用户的连接，返回用户是否存在
+bool OnlineUserRegistry::remove(int id)
+{
+    Shard &shard = _shards[shardIndex(id)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.conns.erase(id) > 0;
+}
+
+// 仅当用户当前记录的连接是conn时才删除，返回是否删除
+bool OnlineUserRegistry::remove(int id, const TcpConnectionPtr &conn)
+{
+    Shard &shard = _shards[shardIndex(id)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.conns.find(id);
+    if (it != shard.conns.end() && it->second == conn)
+    {
+        shard.conns.erase(it);
+        return true;
+    }
+    return false;
+}
+
+// 批量查找，每个分片只加一次锁
+void OnlineUserRegistry::findMany(const std::vector<int> &ids,
+                                  std::vector<std::pair<int, TcpConnectionPtr>> &found,
+                                  std::vector<int> &missing)
+{
+    // 先按分片归类，再逐个分片加锁查找
+    std::vector<int> buckets[kShardCount];
+    for (int id : ids)
+    {
+        buckets[shardIndex(id)].push_back(id);
+    }
+
+    for (size_t i = 0; i < kShardCount; ++i)
+    {
+        if (buckets[i].empty())
+        {
+            continue;
+        }
+
+        Shard &shard = _shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (int id : buckets[i])
+        {
+            auto it = shard.conns.find(id);
+            if (it != shard.conns.end())
+            {
+                found.emplace_back(id, it->second);
+            }
+            else
+            {
+                missing.push_back(id);
+            }
+        }
+    }
+}
+
+// 在线用户总数
+size_t OnlineUserRegistry::size()
+{
+    size_t total = 0;
+    for (Shard &shard : _shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.conns.size();
+    }
+    return total;
+}
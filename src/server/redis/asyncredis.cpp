@@ -0,0 +1,265 @@
+#include "asyncredis.hpp"
+#include <muduo/base/Logging.h>
+
+AsyncRedis::AsyncRedis(EventLoop *loop, const std::string &ip, int port)
+    : _loop(loop),
+      _ip(ip),
+      _port(port),
+      _context(nullptr),
+      _connected(false),
+      _reconnecting(false)
+{
+}
+
+AsyncRedis::~AsyncRedis()
+{
+    _loop->assertInLoopThread();
+    if (_context != nullptr)
+    {
+        // 先断开上下文和对象的关联，释放上下文时触发的回调不再访问本对象
+        _context->data = nullptr;
+        redisAsyncFree(_context);
+        _context = nullptr;
+    }
+
+    for (Command &cmd : _pending)
+    {
+        if (cmd.cb)
+        {
+            cmd.cb(nullptr);
+        }
+    }
+}
+
+// 发起连接，连接断开后自动重连
+void AsyncRedis::connect()
+{
+    _loop->runInLoop([this]()
+                     {
+        _reconnecting = false;
+        if (_context != nullptr)
+        {
+            return;
+        }
+
+        _context = redisAsyncConnect(_ip.c_str(), _port);
+        if (_context == nullptr || _context->err != 0)
+        {
+            LOG_ERROR << "async redis connect " << _ip << ":" << _port << " failed:"
+                      << (_context ? _context->errstr : "nullptr");
+            if (_context != nullptr)
+            {
+                redisAsyncFree(_context);
+                _context = nullptr;
+            }
+            scheduleReconnect();
+            return;
+        }
+
+        _context->data = this;
+
+        // 把hiredis的读写事件注册到muduo的Channel上
+        _channel.reset(new Channel(_loop, _context->c.fd));
+        _channel->setReadCallback(std::bind(&AsyncRedis::handleRead, this, std::placeholders::_1));
+        _channel->setWriteCallback(std::bind(&AsyncRedis::handleWrite, this));
+
+        _context->ev.data = this;
+        _context->ev.addRead = addRead;
+        _context->ev.delRead = delRead;
+        _context->ev.addWrite = addWrite;
+        _context->ev.delWrite = delWrite;
+        _context->ev.cleanup = cleanup;
+
+        redisAsyncSetConnectCallback(_context, connectCallback);
+        redisAsyncSetDisconnectCallback(_context, disconnectCallback); });
+}
+
+// 发送任意命令，可在任意线程调用
+void AsyncRedis::command(std::vector<std::string> argv, CommandCallback cb)
+{
+    auto cmd = std::make_shared<Command>();
+    cmd->argv = std::move(argv);
+    cmd->cb = std::move(cb);
+    _loop->runInLoop([this, cmd]()
+                     { commandInLoop(std::move(*cmd)); });
+}
+
+// 向通道发布消息，可在任意线程调用
+void AsyncRedis::publish(const std::string &channel, const std::string &message, PublishCallback done)
+{
+    command({"PUBLISH", channel, message}, [done](redisReply *reply)
+            {
+        bool ok = reply != nullptr && reply->type != REDIS_REPLY_ERROR;
+        if (done)
+        {
+            done(ok, ok && reply->type == REDIS_REPLY_INTEGER ? reply->integer : 0);
+        } });
+}
+
+// 在_loop线程中发送命令，未连接时先暂存
+void AsyncRedis::commandInLoop(Command cmd)
+{
+    if (_connected)
+    {
+        sendCommand(cmd);
+        return;
+    }
+
+    if (_pending.size() >= kMaxPendingCommands)
+    {
+        LOG_ERROR << "async redis is disconnected, too many pending commands, drop command " << cmd.argv[0];
+        if (cmd.cb)
+        {
+            cmd.cb(nullptr);
+        }
+        return;
+    }
+    _pending.push_back(std::move(cmd));
+}
+
+// 把命令写入hiredis的发送缓冲区，真正的发送在Channel可写时进行，同一次循环中的多条命令一起发送
+void AsyncRedis::sendCommand(Command &cmd)
+{
+    std::vector<const char *> argv;
+    std::vector<size_t> argvlen;
+    argv.reserve(cmd.argv.size());
+    argvlen.reserve(cmd.argv.size());
+    for (const std::string &arg : cmd.argv)
+    {
+        argv.push_back(arg.data());
+        argvlen.push_back(arg.size());
+    }
+
+    // privdata持有回调对象，在commandCallback中释放
+    CommandCallback *cb = new CommandCallback(std::move(cmd.cb));
+    if (redisAsyncCommandArgv(_context, commandCallback, cb, static_cast<int>(argv.size()),
+                              argv.data(), argvlen.data()) != REDIS_OK)
+    {
+        LOG_ERROR << "async redis command " << cmd.argv[0] << " failed!";
+        if (*cb)
+        {
+            (*cb)(nullptr);
+        }
+        delete cb;
+    }
+}
+
+// 连接断开或连接失败后，延时重连
+void AsyncRedis::scheduleReconnect()
+{
+    if (_reconnecting)
+    {
+        return;
+    }
+    _reconnecting = true;
+    _loop->runAfter(kReconnectInterval, std::bind(&AsyncRedis::connect, this));
+}
+
+// hiredis上下文被释放后，清理对应的Channel
+void AsyncRedis::cleanupChannel()
+{
+    if (_channel)
+    {
+        _channel->disableAll();
+        _channel->remove();
+
+        // cleanup可能在Channel的事件回调中被调用，此时不能析构Channel，延迟到本次事件处理结束后释放
+        std::shared_ptr<Channel> channel = _channel;
+        _loop->queueInLoop([channel]() {});
+        _channel.reset();
+    }
+}
+
+void AsyncRedis::handleRead(Timestamp receiveTime)
+{
+    redisAsyncHandleRead(_context);
+}
+
+void AsyncRedis::handleWrite()
+{
+    redisAsyncHandleWrite(_context);
+}
+
+AsyncRedis *AsyncRedis::getRedis(const redisAsyncContext *ac)
+{
+    return static_cast<AsyncRedis *>(ac->data);
+}
+
+void AsyncRedis::connectCallback(const redisAsyncContext *ac, int status)
+{
+    AsyncRedis *redis = getRedis(ac);
+    if (redis == nullptr)
+    {
+        return;
+    }
+
+    if (status != REDIS_OK)
+    {
+        // 连接失败，hiredis会在回调返回后释放上下文
+        LOG_ERROR << "async redis connect failed:" << ac->errstr;
+        redis->_context = nullptr;
+        redis->scheduleReconnect();
+        return;
+    }
+
+    LOG_INFO << "async redis connected to " << redis->_ip << ":" << redis->_port;
+    redis->_connected = true;
+
+    // 发送断线期间暂存的命令
+    while (!redis->_pending.empty())
+    {
+        Command cmd = std::move(redis->_pending.front());
+        redis->_pending.pop_front();
+        redis->sendCommand(cmd);
+    }
+}
+
+void AsyncRedis::disconnectCallback(const redisAsyncContext *ac, int status)
+{
+    AsyncRedis *redis = getRedis(ac);
+    if (redis == nullptr)
+    {
+        return;
+    }
+
+    // 连接断开，hiredis会在回调返回后释放上下文，未完成命令的回调会收到nullptr
+    LOG_ERROR << "async redis disconnected:" << (status == REDIS_OK ? "ok" : ac->errstr);
+    redis->_connected = false;
+    redis->_context = nullptr;
+    redis->scheduleReconnect();
+}
+
+void AsyncRedis::commandCallback(redisAsyncContext *ac, void *reply, void *privdata)
+{
+    CommandCallback *cb = static_cast<CommandCallback *>(privdata);
+    if (*cb)
+    {
+        (*cb)(static_cast<redisReply *>(reply));
+    }
+    delete cb;
+}
+
+void AsyncRedis::addRead(void *privdata)
+{
+    static_cast<AsyncRedis *>(privdata)->_channel->enableReading();
+}
+
+void AsyncRedis::delRead(void *privdata)
+{
+    static_cast<AsyncRedis *>(privdata)->_channel->disableReading();
+}
+
+void AsyncRedis::addWrite(void *privdata)
+{
+    static_cast<AsyncRedis *>(privdata)->_channel->enableWriting();
+}
+
+void AsyncRedis::delWrite(void *privdata)
+{
+    static_cast<AsyncRedis *>(privdata)->_channel->disableWriting();
+}
+
+void AsyncRedis::cleanup(void *privdata)
+{
+    static_cast<AsyncRedis *>(privdata)->cleanupChannel();
+}
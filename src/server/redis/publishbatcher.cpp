@@ -0,0 +1,59 @@
+#include "publishbatcher.hpp"
+
+PublishBatcher::PublishBatcher(AsyncRedis *redis, double flushDelay)
+    : _redis(redis), _flushDelay(flushDelay), _flushScheduled(false)
+{
+}
+
+// 提交一条发布请求，可在任意线程调用，done在发布完成后在redis线程中回调
+void PublishBatcher::publish(std::string channel, std::string message, AsyncRedis::PublishCallback done)
+{
+    bool schedule = false;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _entries.push_back({std::move(channel), std::move(message), std::move(done)});
+        if (!_flushScheduled)
+        {
+            _flushScheduled = true;
+            schedule = true;
+        }
+    }
+
+    // 一批请求只唤醒一次redis线程，queueInLoop保证即使在redis线程中调用，也会等到本轮事件处理结束后再发送
+    if (schedule)
+    {
+        EventLoop *loop = _redis->getLoop();
+        if (_flushDelay > 0)
+        {
+            loop->runAfter(_flushDelay, std::bind(&PublishBatcher::flush, this));
+        }
+        else
+        {
+            loop->queueInLoop(std::bind(&PublishBatcher::flush, this));
+        }
+    }
+}
+
+// 当前排队等待发送的发布请求数量
+size_t PublishBatcher::pending()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _entries.size();
+}
+
+// 在redis线程中把队列中的所有发布请求一次性发送
+void PublishBatcher::flush()
+{
+    std::vector<Entry> entries;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        entries.swap(_entries);
+        _flushScheduled = false;
+    }
+
+    // 在redis线程中调用publish会直接追加到hiredis的发送缓冲区，所有命令在Channel可写时一次写出
+    for (Entry &entry : entries)
+    {
+        _redis->publish(entry.channel, entry.message, std::move(entry.done));
+    }
+}
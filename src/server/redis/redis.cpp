@@ -1,22 +1,37 @@
 #include "redis.hpp"
+#include <muduo/base/Logging.h>
 #include <iostream>
 #include <iomanip>
 #include <cstring>
 #include <string>
 #include <mutex>
 
+// 每发布多少条消息打印一次调试日志
+static const uint64_t kPublishLogSampleRate = 1024;
+
 Redis::Redis()
-    : _publish_context(nullptr), _subscribe_context(nullptr)
+    : _command_context(nullptr), _published(0), _publish_failed(0), _subscribe_context(nullptr)
 {
 }
 
 Redis::~Redis()
 {
-    if (_publish_context != nullptr)
+    if (_command_context != nullptr)
     {
-        redisFree(_publish_context);
+        // 异步上下文只能在它所在的事件循环线程中释放，释放后本轮循环结束即退出，
+        // 不再触发批处理器安排的定时发送
+        AsyncRedis *context = _command_context;
+        EventLoop *loop = context->getLoop();
+        loop->runInLoop([context, loop]()
+                        {
+                            delete context;
+                            loop->quit(); });
     }
 
+    // 先停止并等待redis线程退出，再释放批处理器，避免还在队列中的flush回调访问已释放的批处理器
+    _command_loop_thread.reset();
+    _publish_batcher.reset();
+
     if (_subscribe_context != nullptr)
     {
         redisFree(_subscribe_context);
@@ -26,14 +41,12 @@ Redis::~Redis()
 // 连接redis服务器
 bool Redis::connect()
 {
-    // 负责publish发布消息的上下文连接
-    _publish_context = redisConnect("127.0.0.1", 6379);
-    if (_publish_context == nullptr || _publish_context->err != 0)
-    {
-        cerr << "Failed to connect publish redis! err: "
-             << (_publish_context ? _publish_context->errstr : "nullptr") << endl;
-        return false;
-    }
+    // 负责publish发布消息和其它命令的异步上下文连接，由独立的事件循环线程驱动，断线后自动重连
+    _command_loop_thread.reset(new EventLoopThread(EventLoopThread::ThreadInitCallback(), "RedisCommand"));
+    EventLoop *loop = _command_loop_thread->startLoop();
+    _command_context = new AsyncRedis(loop, "127.0.0.1", 6379);
+    _command_context->connect();
+    _publish_batcher.reset(new PublishBatcher(_command_context));
 
     // 负责subscribe订阅消息的上下文连接
     _subscribe_context = redisConnect("127.0.0.1", 6379);
@@ -54,54 +67,52 @@ bool Redis::connect()
     return true;
 }
 
-// 向redis指定的通道channel发布消息
-bool Redis::publish(int channel, string message)
+// 向redis指定的通道channel发布消息，异步发送不阻塞调用线程，返回是否成功提交
+bool Redis::publish(const string &channel, const string &message, AsyncRedis::PublishCallback done)
 {
-    // ====== 步骤1：验证发布上下文是否有效（避免连接异常导致发送失败）======
-    if (_publish_context == nullptr || _publish_context->err != 0)
+    if (_command_context == nullptr)
     {
-        cerr << "【发布失败】Redis 发布上下文错误：" << (_publish_context ? _publish_context->errstr : "nullptr") << endl;
+        cerr << "【发布失败】Redis 发布上下文未初始化" << endl;
         return false;
     }
 
-    // // ====== 步骤2：打印发布前的消息（确认消息正常）======
-    // std::cout << "【发布前消息】长度：" << message.size() << "字节" << std::endl;
-    // std::cout << "【发布前字符串】：" << message << std::endl;
-
-    // redisReply *reply = (redisReply *)redisCommand(_publish_context, "PUBLISH %d %s", channel, message);
-
-    // ====== 步骤3：使用 %b 格式符发布（二进制安全，避免截断和格式符解析错误）======
-    // 格式：PUBLISH <channel> <message>，其中 %b 表示二进制数据（data, len）
-    redisReply *reply = (redisReply *)redisCommand(
-        _publish_context,
-        "PUBLISH %d %b", // %d：通道号（整数），%b：二进制数据（安全处理任意字符）
-        channel,         // 参数1：通道号（int）
-        message.c_str(), // 参数2：消息数据（const char*，二进制安全）
-        message.size()   // 参数3：消息长度（size_t，显式指定长度，避免 \0 截断）
-    );
-
-    // ====== 步骤4：检查发布结果======
-    if (reply == nullptr)
-    {
-        cerr << "Failed to reply publish command!" << endl;
-        return false;
-    }
+    // 交给批处理器，与同一轮事件循环中的其它发布请求一起流水线发送，每条消息的发布结果在回调中上报
+    _publish_batcher->publish(channel, message, [this, channel, done](bool ok, long long receivers)
+                              {
+        if (ok)
+        {
+            uint64_t published = ++_published;
+            if (published % kPublishLogSampleRate == 0)
+            {
+                LOG_DEBUG << "redis published:" << published << " failed:" << _publish_failed.load();
+            }
+        }
+        else
+        {
+            ++_publish_failed;
+            LOG_ERROR << "redis publish to channel " << channel << " failed!";
+        }
+        if (done)
+        {
+            done(ok, receivers);
+        } });
+    return true;
+}
 
-    if (reply->type == REDIS_REPLY_ERROR)
+// 通过异步上下文发送任意命令，回调在redis线程中执行，失败时reply为nullptr，返回是否成功提交
+bool Redis::command(vector<string> argv, AsyncRedis::CommandCallback cb)
+{
+    if (_command_context == nullptr)
     {
-        std::cerr << "【发布失败】Redis 错误：" << reply->str << std::endl;
-        freeReplyObject(reply);
         return false;
     }
 
-    // ====== 步骤5：释放回复并返回成功======
-    freeReplyObject(reply);
-    cout << "【发布成功】消息已发送到 Redis 通道 " << channel << endl;
+    _command_context->command(std::move(argv), std::move(cb));
     return true;
 }
 
 // 向redis指定的通道subscribe订阅消息
-bool Redis::subscribe(int channel)
+bool Redis::subscribe(const string &channel)
 {
     // redisCommand = redisAppendCommand + redisBufferWrite + redisGetReply
     // redisAppendCommand把命令写到本地缓存
@@ -127,7 +138,7 @@ bool Redis::subscribe(int channel)
         }
     }
 
-    if (redisAppendCommand(this->_subscribe_context, "SUBSCRIBE %d", channel) == REDIS_ERR)
+    if (redisAppendCommand(this->_subscribe_context, "SUBSCRIBE %b", channel.c_str(), channel.size()) == REDIS_ERR)
     {
         cerr << "Failed to reply subscribe command!" << endl;
         return false;
@@ -149,10 +160,10 @@ bool Redis::subscribe(int channel)
 }
 
 // 向redis指定的通道unsubscribe取消订阅消息
-bool Redis::unsubscribe(int channel)
+bool Redis::unsubscribe(const string &channel)
 {
     std::lock_guard<std::mutex> lock(_subscribe_mutex); // 加锁
-    if (redisAppendCommand(this->_subscribe_context, "UNSUBSCRIBE %d", channel) == REDIS_ERR)
+    if (redisAppendCommand(this->_subscribe_context, "UNSUBSCRIBE %b", channel.c_str(), channel.size()) == REDIS_ERR)
     {
         cerr << "Failed to reply unsubscribe command!" << endl;
         return false;
@@ -187,8 +198,8 @@ void Redis::observer_channel_message()
         }
 
         redisReply *type_elem = reply->element[0];    // 第一个元素："message"
-        redisReply *channel_elem = reply->element[1]; // 第二个元素：通道名（user_id）
-        redisReply *msg_elem = reply->element[2];     // 第三个元素：消息内容（JSON字符串）
+        redisReply *channel_elem = reply->element[1]; // 第二个元素：通道名
+        redisReply *msg_elem = reply->element[2];     // 第三个元素：消息内容
 
         // 验证元素类型和内容有效性
         if (type_elem->type != REDIS_REPLY_STRING || strcmp(type_elem->str, "message") != 0 ||
@@ -200,12 +211,23 @@ void Redis::observer_channel_message()
             continue;
         }
 
-        // 提取用户ID和消息内容（按长度读取，二进制安全）
-        int user_id = atoi(channel_elem->str);
+        // 提取通道名和消息内容（按长度读取，二进制安全）
+        string channel(channel_elem->str, channel_elem->len);
         string message(msg_elem->str, msg_elem->len); // 关键：用msg_elem->len确保完整读取
 
-        // 调用业务层处理函数（转发给客户端）
-        _notify_message_handler(user_id, message);
+        // 调用业务层处理函数（转发给客户端），单条消息处理失败不能让订阅线程退出
+        try
+        {
+            _notify_message_handler(channel, message);
+        }
+        catch (const exception &e)
+        {
+            cerr << "处理Redis订阅消息失败，通道：" << channel << "，原因：" << e.what() << endl;
+        }
+        catch (...)
+        {
+            cerr << "处理Redis订阅消息失败，通道：" << channel << endl;
+        }
 
         // // 订阅收到的消息是一个带三元素的数组
         // if (reply != nullptr && reply->element[2] != nullptr && reply->element[2]->str != nullptr)
@@ -231,7 +253,7 @@ void Redis::observer_channel_message()
 }
 
 // 初始化向业务层上报通道消息的回调对象
-void Redis::init_notify_handler(function<void(int, string)> fn)
+void Redis::init_notify_handler(function<void(string, string)> fn)
 {
     this->_notify_message_handler = fn;
 }
\ No newline at end of file
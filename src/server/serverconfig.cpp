@@ -0,0 +1,262 @@
+#include "serverconfig.hpp"
+#include <getopt.h>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+// 命令行选项，配置文件中的key与长选项同名
+// 布尔选项的值可选：--reuseport 等价于 --reuseport=true，--reuseport=false 可以覆盖配置文件中的true
+static const struct option kOptions[] = {
+    {"config", required_argument, nullptr, 'c'},
+    {"ip", required_argument, nullptr, 'i'},
+    {"port", required_argument, nullptr, 'p'},
+    {"node-id", required_argument, nullptr, 'n'},
+    {"io-threads", required_argument, nullptr, 't'},
+    {"worker-threads", required_argument, nullptr, 'w'},
+    {"reuseport", optional_argument, nullptr, 'r'},
+    {"cpu-affinity", optional_argument, nullptr, 'a'},
+    {"cork-delay-ms", required_argument, nullptr, 'd'},
+    {"relay-validate", optional_argument, nullptr, 'v'},
+    {"help", no_argument, nullptr, 'h'},
+    {nullptr, 0, nullptr, 0}};
+static const char *kShortOptions = "c:i:p:n:t:w:r::a::d:v::h";
+
+// 去掉字符串首尾的空白
+static string trim(const string &str)
+{
+    size_t begin = str.find_first_not_of(" \t\r\n");
+    if (begin == string::npos)
+    {
+        return string();
+    }
+    size_t end = str.find_last_not_of(" \t\r\n");
+    return str.substr(begin, end - begin + 1);
+}
+
+// 解析[min, max]范围内的整数，格式错误返回false
+static bool parseInt(const string &value, long min, long max, long &result)
+{
+    char *end = nullptr;
+    errno = 0;
+    result = strtol(value.c_str(), &end, 10);
+    return !value.empty() && *end == '\0' && errno == 0 && result >= min && result <= max;
+}
+
+// 解析布尔值，支持true/false、yes/no、on/off、1/0
+static bool parseBool(const string &value, bool &result)
+{
+    if (value == "true" || value == "yes" || value == "on" || value == "1")
+    {
+        result = true;
+        return true;
+    }
+    if (value == "false" || value == "no" || value == "off" || value == "0")
+    {
+        result = false;
+        return true;
+    }
+    return false;
+}
+
+// 解析命令行参数，-c指定的配置文件先于其它选项读取，失败时在err中返回原因
+bool ServerConfig::parse(int argc, char **argv, string &err)
+{
+    // 第一遍只找配置文件，命令行上的其它选项覆盖配置文件中的值
+    // glibc中optind置0会重新初始化getopt的内部状态
+    opterr = 0;
+    optind = 0;
+    int opt;
+    while ((opt = getopt_long(argc, argv, kShortOptions, kOptions, nullptr)) != -1)
+    {
+        if (opt == 'c' && !load(optarg, err))
+        {
+            return false;
+        }
+    }
+
+    // 第二遍应用其它选项
+    optind = 0;
+    while ((opt = getopt_long(argc, argv, kShortOptions, kOptions, nullptr)) != -1)
+    {
+        if (opt == 'c')
+        {
+            continue;
+        }
+        if (opt == 'h')
+        {
+            err.clear();
+            return false;
+        }
+        if (opt == '?')
+        {
+            err = string("invalid option: ") + argv[optind - 1];
+            return false;
+        }
+
+        const struct option *option = kOptions;
+        while (option->val != opt)
+        {
+            ++option;
+        }
+        // 没有给出值的布尔选项表示打开
+        if (!set(option->name, optarg != nullptr ? optarg : "true", err))
+        {
+            return false;
+        }
+    }
+
+    // 兼容原来的位置参数：ip port [业务线程数量]
+    const char *positional[] = {"ip", "port", "worker-threads"};
+    for (int i = 0; optind < argc; ++i, ++optind)
+    {
+        if (i >= 3)
+        {
+            err = string("unexpected argument: ") + argv[optind];
+            return false;
+        }
+        if (!set(positional[i], argv[optind], err))
+        {
+            return false;
+        }
+    }
+
+    if (ip.empty() || port == 0)
+    {
+        err = "ip and port are required";
+        return false;
+    }
+
+    // 默认节点id由主机名和监听地址生成，重启后不变；但同一主机上可以有多个进程用SO_REUSEPORT监听同一端口，
+    // 默认节点id会重复，需要显式配置稳定且不重复的节点id
+    if (reusePort && nodeId.empty())
+    {
+        err = "node_id is required when reuseport is on";
+        return false;
+    }
+    return true;
+}
+
+// 读取配置文件，失败时在err中返回原因
+bool ServerConfig::load(const string &path, string &err)
+{
+    ifstream in(path);
+    if (!in)
+    {
+        err = "can not open config file " + path;
+        return false;
+    }
+
+    string line;
+    for (int lineNo = 1; getline(in, line); ++lineNo)
+    {
+        line = trim(line);
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        size_t pos = line.find('=');
+        if (pos == string::npos)
+        {
+            err = path + ":" + to_string(lineNo) + ": expected key = value";
+            return false;
+        }
+        if (!set(trim(line.substr(0, pos)), trim(line.substr(pos + 1)), err))
+        {
+            err = path + ":" + to_string(lineNo) + ": " + err;
+            return false;
+        }
+    }
+    return true;
+}
+
+// 设置一项配置，key使用长选项的名字
+bool ServerConfig::set(const string &name, const string &value, string &err)
+{
+    string key = name;
+    replace(key.begin(), key.end(), '_', '-');
+
+    long number = 0;
+    bool ok = true;
+    if (key == "ip")
+    {
+        ip = value;
+        ok = !value.empty();
+    }
+    else if (key == "port")
+    {
+        ok = parseInt(value, 1, 65535, number);
+        port = static_cast<uint16_t>(number);
+    }
+    else if (key == "node-id")
+    {
+        // 节点id用在redis的键名和通道名中，不能为空，也不能有空白
+        nodeId = value;
+        ok = !value.empty() && value.find_first_of(" \t\r\n") == string::npos;
+    }
+    else if (key == "io-threads")
+    {
+        ok = parseInt(value, 0, 1024, number);
+        ioThreads = static_cast<int>(number);
+    }
+    else if (key == "worker-threads")
+    {
+        ok = parseInt(value, 0, 1024, number);
+        workerThreads = static_cast<int>(number);
+    }
+    else if (key == "reuseport")
+    {
+        ok = parseBool(value, reusePort);
+    }
+    else if (key == "cpu-affinity")
+    {
+        ok = parseBool(value, cpuAffinity);
+    }
+    else if (key == "cork-delay-ms")
+    {
+        char *end = nullptr;
+        corkDelayMs = strtod(value.c_str(), &end);
+        ok = !value.empty() && *end == '\0' && corkDelayMs >= 0;
+    }
+    else if (key == "relay-validate")
+    {
+        ok = parseBool(value, relayValidate);
+    }
+    else
+    {
+        err = "unknown option " + name;
+        return false;
+    }
+
+    if (!ok)
+    {
+        err = "invalid value for " + name + ": " + value;
+    }
+    return ok;
+}
+
+// 打印命令行用法
+void ServerConfig::usage(const char *prog)
+{
+    cerr << "usage: " << prog << " [options] [ip port [worker_threads]]\n"
+         << "  -c, --config FILE          config file, one key = value per line, keys are the long options\n"
+         << "  -i, --ip IP                listen ip\n"
+         << "  -p, --port PORT            listen port\n"
+         << "  -n, --node-id ID           stable node id in the cluster, required with --reuseport\n"
+         << "                             (default hostname:ip:port)\n"
+         << "  -t, --io-threads N         io threads (default 4)\n"
+         << "  -w, --worker-threads N     worker threads (default 8)\n"
+         << "  -r, --reuseport[=BOOL]     one SO_REUSEPORT listener per io thread\n"
+         << "  -a, --cpu-affinity[=BOOL]  pin io threads to the cpus this process may run on\n"
+         << "  -d, --cork-delay-ms MS     max delay before coalesced frames are sent (default 0)\n"
+         << "  -v, --relay-validate[=BOOL]\n"
+         << "                             validate the content of messages relayed from other nodes (debug)\n"
+         << "  -h, --help                 show this help\n"
+         << "boolean options without a value mean true, use --reuseport=false to override a config file\n"
+         << "example: " << prog << " 127.0.0.1 6000\n"
+         << "         " << prog << " -c chatserver.conf -t 16 --reuseport --node-id chat-1" << endl;
+}
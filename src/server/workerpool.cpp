@@ -0,0 +1,73 @@
+#include "workerpool.hpp"
+#include <algorithm>
+
+WorkerPool::WorkerPool(const std::string &name)
+    : _name(name), _numThreads(0)
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+// 设置工作线程数量，必须在start之前调用，0表示不启用线程池，任务直接在调用线程中执行
+void WorkerPool::setThreadNum(int numThreads)
+{
+    _numThreads = std::max(numThreads, 0);
+}
+
+// 启动所有工作线程
+void WorkerPool::start()
+{
+    for (int i = 0; i < _numThreads; ++i)
+    {
+        // 每个ThreadPool只有一个线程，保证投递到同一个ThreadPool的任务串行、按顺序执行
+        std::unique_ptr<muduo::ThreadPool> worker(new muduo::ThreadPool(_name + std::to_string(i)));
+        worker->start(1);
+        _workers.push_back(std::move(worker));
+    }
+}
+
+// 停止所有工作线程
+void WorkerPool::stop()
+{
+    for (auto &worker : _workers)
+    {
+        worker->stop();
+    }
+    _workers.clear();
+}
+
+// 根据key选择工作线程，投递任务
+void WorkerPool::run(size_t key, Task task)
+{
+    if (_workers.empty())
+    {
+        task();
+        return;
+    }
+    _workers[key % _workers.size()]->run(std::move(task));
+}
+
+// 所有工作线程排队等待执行的任务总数
+size_t WorkerPool::queueSize() const
+{
+    size_t total = 0;
+    for (auto &worker : _workers)
+    {
+        total += worker->queueSize();
+    }
+    return total;
+}
+
+// 排队任务最多的工作线程的队列长度
+size_t WorkerPool::maxQueueSize() const
+{
+    size_t maxSize = 0;
+    for (auto &worker : _workers)
+    {
+        maxSize = std::max(maxSize, worker->queueSize());
+    }
+    return maxSize;
+}
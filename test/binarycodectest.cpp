@@ -0,0 +1,225 @@
+// BinaryCodec的编解码测试
+// 随机生成聊天消息，检查二进制编码和JSON转换都能原样还原；截断到每一个长度、随机修改字节和随机数据都不能崩溃，
+// 截断后只有恰好停在字段边界的数据能解码，解码出的字段与原消息一致；不能无损转换的JSON消息fromJson返回false
+// 编译：g++ -std=c++17 -O2 -Iinclude -Ithirdparty test/binarycodectest.cpp -o BinaryCodecTest
+#include "binarycodec.hpp"
+#include "json.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+using json = nlohmann::json;
+using namespace std;
+
+static bool equal(const BinaryCodec::ChatMessage &a, const BinaryCodec::ChatMessage &b)
+{
+    return a.msgid == b.msgid && a.id == b.id && a.to == b.to && a.time == b.time && a.name == b.name && a.msg == b.msg;
+}
+
+static string describe(const BinaryCodec::ChatMessage &m)
+{
+    return "msgid:" + to_string(m.msgid) + " id:" + to_string(m.id) + " to:" + to_string(m.to) + " time:" + to_string(m.time) +
+           " name:" + to_string(m.name.size()) + "B msg:" + to_string(m.msg.size()) + "B";
+}
+
+// 变长整数编码的长度
+static size_t varintLen(uint64_t value)
+{
+    size_t len = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        ++len;
+    }
+    return len;
+}
+
+// 随机字符串，长度分布覆盖1字节、2字节和3字节的变长长度；utf8为false时可以是任意字节
+static string randomString(mt19937 &rng, bool utf8)
+{
+    static const size_t kLens[] = {0, 1, 5, 127, 128, 300, 16383, 16384, 20000};
+    size_t len = rng() % 4 == 0 ? kLens[rng() % (sizeof(kLens) / sizeof(kLens[0]))] : rng() % 64;
+    string str;
+    str.reserve(len);
+    for (size_t i = 0; i < len; ++i)
+    {
+        str.push_back(utf8 ? static_cast<char>(' ' + rng() % 95) : static_cast<char>(rng() % 256));
+    }
+    return str;
+}
+
+// 随机聊天消息，时间戳在formatTime能格式化成四位年份的范围内
+static BinaryCodec::ChatMessage randomMessage(mt19937 &rng, bool utf8)
+{
+    static const int32_t kInts[] = {0, 1, -1, INT32_MAX, INT32_MIN};
+    BinaryCodec::ChatMessage m;
+    m.msgid = rng() % 2 == 0 ? ONE_CHAT_MSG : GROUP_CHAT_MSG;
+    m.id = rng() % 4 == 0 ? kInts[rng() % 5] : static_cast<int32_t>(rng());
+    m.to = rng() % 4 == 0 ? kInts[rng() % 5] : static_cast<int32_t>(rng());
+    m.time = static_cast<int64_t>((static_cast<uint64_t>(rng()) << 32 | rng()) % 253402300800ULL);
+    m.name = randomString(rng, utf8);
+    m.msg = randomString(rng, utf8);
+    return m;
+}
+
+// 编码后再解码，以及转换成JSON文本再转换回来，都与原消息一致
+static bool checkRoundTrip(const BinaryCodec::ChatMessage &m, bool utf8)
+{
+    string data = BinaryCodec::encode(m);
+    BinaryCodec::ChatMessage decoded;
+    if (!BinaryCodec::isBinary(data.data(), data.size()) || !BinaryCodec::decode(data.data(), data.size(), decoded) ||
+        !equal(m, decoded))
+    {
+        cerr << "binary round trip failed: " << describe(m) << endl;
+        return false;
+    }
+
+    // 任意字节不是合法的UTF-8，不能序列化成JSON文本
+    if (utf8)
+    {
+        BinaryCodec::ChatMessage converted;
+        json js = json::parse(BinaryCodec::toJson(m).dump());
+        if (!BinaryCodec::fromJson(js, converted) || !equal(m, converted))
+        {
+            cerr << "json round trip failed: " << describe(m) << " json:" << js.dump().substr(0, 200) << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// 截断到每一个长度：只有停在头部之后或者name字段之后的数据能解码，解码出的字段是原消息的前面部分
+static bool checkTruncated(const BinaryCodec::ChatMessage &m)
+{
+    string data = BinaryCodec::encode(m);
+    size_t nameEnd = BinaryCodec::kHeaderLen + 1 + varintLen(m.name.size()) + m.name.size();
+    for (size_t len = 0; len < data.size(); ++len)
+    {
+        BinaryCodec::ChatMessage decoded;
+        bool ok = BinaryCodec::decode(data.data(), len, decoded);
+        bool expect = len == BinaryCodec::kHeaderLen || len == nameEnd;
+        if (ok != expect)
+        {
+            cerr << "truncated to " << len << " of " << data.size() << " decoded:" << ok << " " << describe(m) << endl;
+            return false;
+        }
+        if (ok && (decoded.msgid != m.msgid || decoded.id != m.id || decoded.to != m.to || decoded.time != m.time ||
+                   decoded.name != (len == nameEnd ? m.name : string()) || !decoded.msg.empty()))
+        {
+            cerr << "truncated to " << len << " decoded wrong fields: " << describe(decoded) << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// 任意数据解码成功时，重新编码再解码得到相同的消息
+static bool checkGarbage(const string &data)
+{
+    BinaryCodec::ChatMessage decoded;
+    if (!BinaryCodec::decode(data.data(), data.size(), decoded))
+    {
+        return true;
+    }
+    if (!BinaryCodec::supports(decoded.msgid))
+    {
+        cerr << "decoded unsupported msgid " << decoded.msgid << endl;
+        return false;
+    }
+    string again = BinaryCodec::encode(decoded);
+    BinaryCodec::ChatMessage redecoded;
+    if (!BinaryCodec::decode(again.data(), again.size(), redecoded) || !equal(decoded, redecoded))
+    {
+        cerr << "garbage re-encode mismatch: " << describe(decoded) << endl;
+        return false;
+    }
+    return true;
+}
+
+// 不能无损转换的JSON消息
+static int checkRejectedJson()
+{
+    const char *cases[] = {
+        R"({"msgid":6,"id":1,"name":"a","to":7,"msg":"hi","time":"2026-01-02 03:04:05","seq":1})",
+        R"({"msgid":6,"id":1,"name":"a","to":7,"msg":"hi"})",
+        R"({"msgid":6,"id":1,"name":"a","group_id":7,"msg":"hi","time":"2026-01-02 03:04:05"})",
+        R"({"msgid":10,"id":1,"name":"a","to":7,"msg":"hi","time":"2026-01-02 03:04:05"})",
+        R"({"msgid":1,"id":1,"name":"a","to":7,"msg":"hi","time":"2026-01-02 03:04:05"})",
+        R"({"msgid":6,"id":"1","name":"a","to":7,"msg":"hi","time":"2026-01-02 03:04:05"})",
+        R"({"msgid":6,"id":1,"name":2,"to":7,"msg":"hi","time":"2026-01-02 03:04:05"})",
+        R"({"msgid":6,"id":1,"name":"a","to":7,"msg":null,"time":"2026-01-02 03:04:05"})",
+        R"({"msgid":6,"id":2147483648,"name":"a","to":7,"msg":"hi","time":"2026-01-02 03:04:05"})",
+        R"({"msgid":6,"id":1,"name":"a","to":-2147483649,"msg":"hi","time":"2026-01-02 03:04:05"})",
+        R"({"msgid":6,"id":1.5,"name":"a","to":7,"msg":"hi","time":"2026-01-02 03:04:05"})",
+        R"({"msgid":6,"id":1,"name":"a","to":7,"msg":"hi","time":"2026-1-2 3:04:05"})",
+        R"({"msgid":6,"id":1,"name":"a","to":7,"msg":"hi","time":"2026-02-30 03:04:05"})",
+        R"({"msgid":6,"id":1,"name":"a","to":7,"msg":"hi","time":"2026-01-02 03:04:05 "})",
+        R"({"msgid":6,"id":1,"name":"a","to":7,"msg":"hi","time":"now"})",
+        R"([6,1,"a",7,"hi","2026-01-02 03:04:05"])"};
+
+    int failed = 0;
+    for (const char *text : cases)
+    {
+        BinaryCodec::ChatMessage m;
+        if (BinaryCodec::fromJson(json::parse(text), m))
+        {
+            cerr << "fromJson accepted " << text << endl;
+            ++failed;
+        }
+    }
+
+    // 规范格式的消息可以转换，转换回来的JSON与原消息相同
+    json js = json::parse(R"({"msgid":10,"id":1,"name":"a","group_id":7,"msg":"hi","time":"2026-01-02 03:04:05"})");
+    BinaryCodec::ChatMessage m;
+    if (!BinaryCodec::fromJson(js, m) || BinaryCodec::toJson(m) != js)
+    {
+        cerr << "fromJson rejected " << js.dump() << endl;
+        ++failed;
+    }
+    return failed;
+}
+
+// 用法：BinaryCodecTest [消息数量 随机种子]
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+    unsigned seed = argc > 2 ? static_cast<unsigned>(atoi(argv[2])) : 1;
+    mt19937 rng(seed);
+
+    int failed = checkRejectedJson();
+    int checked = 0;
+    for (int i = 0; i < rounds; ++i)
+    {
+        bool utf8 = i % 2 == 0;
+        BinaryCodec::ChatMessage m = randomMessage(rng, utf8);
+        failed += checkRoundTrip(m, utf8) ? 0 : 1;
+        failed += checkTruncated(m) ? 0 : 1;
+
+        // 在合法的编码上随机修改几个字节
+        string data = BinaryCodec::encode(m);
+        for (int j = 0; j < 8; ++j)
+        {
+            string mutated = data;
+            int edits = static_cast<int>(rng() % 3) + 1;
+            for (int k = 0; k < edits; ++k)
+            {
+                mutated[rng() % mutated.size()] = static_cast<char>(rng() % 256);
+            }
+            failed += checkGarbage(mutated) ? 0 : 1;
+        }
+
+        // 魔数开头的随机数据
+        string garbage(1, static_cast<char>(BinaryCodec::kMagic));
+        size_t len = rng() % 64;
+        for (size_t j = 0; j < len; ++j)
+        {
+            garbage.push_back(static_cast<char>(rng() % 256));
+        }
+        failed += checkGarbage(garbage) ? 0 : 1;
+        checked += 10;
+    }
+
+    cout << "checked " << checked << " messages, failed " << failed << endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+// JsonRouteScanner与nlohmann::json的对比测试
+// 对一组典型消息做随机的删除、插入、替换，检查扫描器和json::accept对每个变体是否合法的判断一致，
+// 合法时取出的路由字段以及chatFields()的结果与完整解析得到的一致，任何不一致都打印出来并返回非0
+// 编译：g++ -std=c++17 -O2 -Iinclude/server -Ithirdparty test/jsonroutescannertest.cpp -o JsonRouteScannerTest
+#include "jsonroutescanner.hpp"
+#include "json.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+using json = nlohmann::json;
+using namespace std;
+
+// 完整解析得到的顶层int字段，与JsonRouteScanner的规则一致：必须是int范围内的整数
+static bool jsonInt(const json &js, const char *key, int &value)
+{
+    auto it = js.find(key);
+    if (it == js.end() || !it->is_number_integer())
+    {
+        return false;
+    }
+    if (it->is_number_unsigned() ? it->get<uint64_t>() > static_cast<uint64_t>(INT32_MAX)
+                                 : it->get<int64_t>() < INT32_MIN || it->get<int64_t>() > INT32_MAX)
+    {
+        return false;
+    }
+    value = it->get<int>();
+    return true;
+}
+
+// 完整解析得到的顶层字符串字段
+static bool jsonString(const json &js, const char *key)
+{
+    auto it = js.find(key);
+    return it != js.end() && it->is_string();
+}
+
+// 检查一条消息，不一致时返回false
+static bool check(const string &data)
+{
+    JsonRouteScanner scanner;
+    bool scanned = scanner.scan(data.data(), data.size());
+    bool accepted = json::accept(data);
+    json js;
+    if (accepted)
+    {
+        js = json::parse(data);
+        accepted = js.is_object();
+    }
+    if (scanned != accepted)
+    {
+        cerr << "accept mismatch scanner:" << scanned << " json:" << accepted << " data:" << data << endl;
+        return false;
+    }
+    if (!scanned)
+    {
+        return true;
+    }
+
+    // 带转义的键名可能对应任何字段，扫描器此时不保证取出的字段正确，只保证chatFields()返回false，调用方退回到完整解析
+    // 消息中有反斜杠时无法简单判断键名是否带转义，只检查chatFields()返回true的情况下所有字段都与完整解析一致
+    bool exact = data.find('\\') == string::npos;
+    bool compareFields = exact || scanner.chatFields();
+
+    const char *keys[] = {"msgid", "to", "group_id", "seq", "id"};
+    for (const char *key : keys)
+    {
+        int expect = 0, actual = 0;
+        bool hasExpect = jsonInt(js, key, expect);
+        bool hasActual = false;
+        string name = key;
+        if (name == "msgid")
+        {
+            hasActual = scanner.msgid(actual);
+        }
+        else if (name == "to")
+        {
+            hasActual = scanner.to(actual);
+        }
+        else if (name == "group_id")
+        {
+            hasActual = scanner.groupId(actual);
+        }
+        else if (name == "seq")
+        {
+            hasActual = scanner.seq(actual);
+        }
+        else
+        {
+            hasActual = scanner.id(actual);
+        }
+        if (compareFields && (hasExpect != hasActual || (hasExpect && expect != actual)))
+        {
+            cerr << "field " << key << " mismatch scanner:" << hasActual << "/" << actual
+                 << " json:" << hasExpect << "/" << expect << " data:" << data << endl;
+            return false;
+        }
+    }
+
+    int id = 0;
+    bool chatFields = jsonInt(js, "id", id) && jsonString(js, "name") && jsonString(js, "msg") && jsonString(js, "time");
+    if (exact ? scanner.chatFields() != chatFields : scanner.chatFields() && !chatFields)
+    {
+        cerr << "chatFields mismatch scanner:" << scanner.chatFields() << " json:" << chatFields << " data:" << data << endl;
+        return false;
+    }
+    return true;
+}
+
+// 用法：JsonRouteScannerTest [变体数量 随机种子]
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 300000;
+    unsigned seed = argc > 2 ? static_cast<unsigned>(atoi(argv[2])) : 1;
+
+    vector<string> cases = {
+        R"({"msgid":6,"id":1,"name":"a","to":7,"msg":"hi","time":"2026-01-02 03:04:05"})",
+        R"({"msgid":9,"id":1,"name":"a","group_id":3,"seq":12,"msg":"hi","time":"t"})",
+        R"({"msgid":6,"id":"1","name":2,"to":7,"msg":null,"time":[]})",
+        R"({"msgid":6,"to":-2147483648,"id":2147483647})",
+        R"({"to":2147483648,"msgid":6,"id":-2147483649})",
+        R"({"a":[1,2,{"b":null,"c":true}],"msgid":6.0,"to":1e2})",
+        R"({"to":1,"to":2,"name":"x"})",
+        R"({"msgid":6,"id":1,"name":"a","to":7,"msg":"hi","time":"t","\u0074o":8})",
+        R"({"s":"😀","msgid":1})",
+        R"({"s":"😀"})",
+        R"({"s":"\ud83d"})",
+        R"({"s":"\udc00"})",
+        R"({"s":"\x"})",
+        "{\"s\":\"\xc3\xa9\"}",
+        "{\"s\":\"\xc3\"}",
+        "{\"s\":\"\xe0\x80\x80\"}",
+        "{\"s\":\"\xed\xa0\x80\"}",
+        "{\"s\":\"\xf4\x90\x80\x80\"}",
+        "{\"s\":\"a\tb\"}",
+        R"({"a":01})",
+        R"({"a":-})",
+        R"({"a":1.})",
+        R"({"a":.5})",
+        R"({"a":1e})",
+        R"({"a":1e400})",
+        R"({} )",
+        R"( {})",
+        R"({}x)",
+        R"([1])",
+        R"({"a":1,})",
+        R"({"a" 1})",
+        R"({"a":tru})",
+        R"({"a":nul})",
+        R"({"a":[1,]})"};
+
+    int failed = 0;
+    for (const string &data : cases)
+    {
+        failed += check(data) ? 0 : 1;
+    }
+
+    // 随机变体：每次在一条典型消息上做1到3次删除、插入或替换
+    mt19937 rng(seed);
+    string alphabet = "{}[]\":,0123456789-+.eE tfrueanlsqidmg_\\u/\xc3\xa9\xed\xa0\x80";
+    for (int i = 0; i < rounds; ++i)
+    {
+        string data = cases[rng() % cases.size()];
+        int edits = static_cast<int>(rng() % 3) + 1;
+        for (int j = 0; j < edits; ++j)
+        {
+            int op = static_cast<int>(rng() % 3);
+            size_t pos = data.empty() ? 0 : rng() % data.size();
+            char c = alphabet[rng() % alphabet.size()];
+            if (op == 0 && !data.empty())
+            {
+                data.erase(pos, 1);
+            }
+            else if (op == 1)
+            {
+                data.insert(pos, 1, c);
+            }
+            else if (!data.empty())
+            {
+                data[pos] = c;
+            }
+        }
+        failed += check(data) ? 0 : 1;
+    }
+
+    cout << "checked " << cases.size() + rounds << " messages, failed " << failed << endl;
+    return failed == 0 ? 0 : 1;
+}
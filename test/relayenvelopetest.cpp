@@ -0,0 +1,177 @@
+// RelayEnvelope的编解码测试
+// 随机生成接收者、消息和群组时间线序号，检查信封能原样还原；信封截断到每一个长度、后面多出数据都必须解码失败，
+// 随机修改字节和随机数据都不能崩溃，解码成功时重新封装得到完全相同的数据
+// 编译：g++ -std=c++17 -O2 -Iinclude/server/redis test/relayenvelopetest.cpp -o RelayEnvelopeTest
+#include "relayenvelope.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+// 随机信封内容：接收者数量覆盖0、1和较多的情况，只有写入时间线的群消息带序号
+struct Content
+{
+    vector<int> targets;
+    string payload;
+    int groupId = 0;
+    int seq = 0;
+};
+
+static Content randomContent(mt19937 &rng)
+{
+    static const size_t kCounts[] = {0, 1, 2, 500};
+    Content c;
+    size_t count = rng() % 4 == 0 ? kCounts[rng() % 4] : rng() % 16;
+    for (size_t i = 0; i < count; ++i)
+    {
+        c.targets.push_back(static_cast<int>(rng() & 0x7FFFFFFF));
+    }
+    size_t len = rng() % 4 == 0 ? 0 : rng() % 300;
+    for (size_t i = 0; i < len; ++i)
+    {
+        c.payload.push_back(static_cast<char>(rng() % 256));
+    }
+    if (rng() % 2 == 0)
+    {
+        c.groupId = static_cast<int>(rng() & 0x7FFFFFFF) + 1;
+        c.seq = rng() % 2 == 0 ? 0 : static_cast<int>(rng() & 0x7FFFFFFF) + 1;
+    }
+    return c;
+}
+
+// 封装后解析，接收者、序号和消息帧都与原内容一致，消息帧是长度前缀加消息
+static bool checkRoundTrip(const Content &c)
+{
+    string data = RelayEnvelope::encode(c.targets, c.payload, c.groupId, c.seq);
+    vector<int> targets;
+    int groupId = -1, seq = -1;
+    size_t frameOffset = 0;
+    if (!RelayEnvelope::decode(data, targets, groupId, seq, frameOffset))
+    {
+        cerr << "decode failed: " << c.targets.size() << " targets, " << c.payload.size() << " bytes" << endl;
+        return false;
+    }
+
+    uint32_t len = htonl(static_cast<uint32_t>(c.payload.size()));
+    string frame(reinterpret_cast<const char *>(&len), RelayEnvelope::kFrameHeaderLen);
+    frame += c.payload;
+    if (targets != c.targets || groupId != c.groupId || seq != c.seq || data.compare(frameOffset, string::npos, frame) != 0)
+    {
+        cerr << "round trip mismatch: " << c.targets.size() << " targets, group " << c.groupId << " seq " << c.seq << endl;
+        return false;
+    }
+    return true;
+}
+
+// 信封截断到每一个长度，或者后面多出数据，都不能解码
+static bool checkTruncated(const Content &c)
+{
+    string data = RelayEnvelope::encode(c.targets, c.payload, c.groupId, c.seq);
+    vector<int> targets;
+    int groupId = 0, seq = 0;
+    size_t frameOffset = 0;
+    for (size_t len = 0; len < data.size(); ++len)
+    {
+        if (RelayEnvelope::decode(data.substr(0, len), targets, groupId, seq, frameOffset))
+        {
+            cerr << "truncated to " << len << " of " << data.size() << " decoded" << endl;
+            return false;
+        }
+    }
+    if (RelayEnvelope::decode(data + "x", targets, groupId, seq, frameOffset))
+    {
+        cerr << "envelope with trailing data decoded" << endl;
+        return false;
+    }
+    return true;
+}
+
+// 任意数据解码成功时，字段都在合法范围内，重新封装得到完全相同的数据
+static bool checkGarbage(const string &data)
+{
+    vector<int> targets;
+    int groupId = 0, seq = 0;
+    size_t frameOffset = 0;
+    if (!RelayEnvelope::decode(data, targets, groupId, seq, frameOffset))
+    {
+        return true;
+    }
+    if (groupId < 0 || seq < 0 || (seq > 0 && groupId == 0) || frameOffset + RelayEnvelope::kFrameHeaderLen > data.size())
+    {
+        cerr << "decoded invalid header: group " << groupId << " seq " << seq << " offset " << frameOffset << endl;
+        return false;
+    }
+    string payload = data.substr(frameOffset + RelayEnvelope::kFrameHeaderLen);
+    if (RelayEnvelope::encode(targets, payload, groupId, seq) != data)
+    {
+        cerr << "garbage re-encode mismatch: " << targets.size() << " targets, " << payload.size() << " bytes" << endl;
+        return false;
+    }
+    return true;
+}
+
+// 头部中不合法的群组id和序号
+static int checkRejectedHeaders()
+{
+    const int cases[][2] = {{-1, 0}, {0, -1}, {0, 5}, {3, -2}, {INT32_MIN, 0}};
+    int failed = 0;
+    for (auto &header : cases)
+    {
+        string data = RelayEnvelope::encode({1, 2}, "{}", header[0], header[1]);
+        vector<int> targets;
+        int groupId = 0, seq = 0;
+        size_t frameOffset = 0;
+        if (RelayEnvelope::decode(data, targets, groupId, seq, frameOffset))
+        {
+            cerr << "decoded envelope with group " << header[0] << " seq " << header[1] << endl;
+            ++failed;
+        }
+    }
+    return failed;
+}
+
+// 用法：RelayEnvelopeTest [信封数量 随机种子]
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+    unsigned seed = argc > 2 ? static_cast<unsigned>(atoi(argv[2])) : 1;
+    mt19937 rng(seed);
+
+    int failed = checkRejectedHeaders();
+    int checked = 0;
+    for (int i = 0; i < rounds; ++i)
+    {
+        Content c = randomContent(rng);
+        failed += checkRoundTrip(c) ? 0 : 1;
+        failed += checkTruncated(c) ? 0 : 1;
+
+        // 在合法的信封上随机修改几个字节，多数落在消息内容中，重点修改头部
+        string data = RelayEnvelope::encode(c.targets, c.payload, c.groupId, c.seq);
+        for (int j = 0; j < 8; ++j)
+        {
+            string mutated = data;
+            int edits = static_cast<int>(rng() % 3) + 1;
+            for (int k = 0; k < edits; ++k)
+            {
+                size_t range = j % 2 == 0 ? min(mutated.size(), RelayEnvelope::kHeaderLen + 8) : mutated.size();
+                mutated[rng() % range] = static_cast<char>(rng() % 256);
+            }
+            failed += checkGarbage(mutated) ? 0 : 1;
+        }
+
+        // 随机数据
+        string garbage;
+        size_t len = rng() % 64;
+        for (size_t j = 0; j < len; ++j)
+        {
+            garbage.push_back(static_cast<char>(rng() % 4 == 0 ? 0 : rng() % 256));
+        }
+        failed += checkGarbage(garbage) ? 0 : 1;
+        checked += 10;
+    }
+
+    cout << "checked " << checked << " envelopes, failed " << failed << endl;
+    return failed == 0 ? 0 : 1;
+}
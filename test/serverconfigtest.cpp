@@ -0,0 +1,197 @@
+// ServerConfig的命令行和配置文件解析测试
+// 检查默认值、长短选项、可选值的布尔选项、位置参数、配置文件以及命令行覆盖配置文件的顺序，
+// 格式错误的参数和配置文件都返回false并给出原因
+// 编译：g++ -std=c++17 -O2 -Iinclude/server test/serverconfigtest.cpp src/server/serverconfig.cpp -o ServerConfigTest
+#include "serverconfig.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+using namespace std;
+
+static int _failed = 0;
+
+#define EXPECT(cond)                                                                    \
+    do                                                                                  \
+    {                                                                                   \
+        if (!(cond))                                                                    \
+        {                                                                               \
+            cerr << __FILE__ << ":" << __LINE__ << ": expect " #cond " failed" << endl; \
+            ++_failed;                                                                  \
+        }                                                                               \
+    } while (0)
+
+// 用args作为命令行参数解析，args不含程序名
+static bool parse(const vector<string> &args, ServerConfig &config, string &err)
+{
+    // getopt_long会重排argv，每次都使用新的可写副本
+    vector<string> storage{"ChatServer"};
+    storage.insert(storage.end(), args.begin(), args.end());
+    vector<char *> argv;
+    for (string &arg : storage)
+    {
+        argv.push_back(&arg[0]);
+    }
+    argv.push_back(nullptr);
+
+    config = ServerConfig();
+    err.clear();
+    return config.parse(static_cast<int>(storage.size()), argv.data(), err);
+}
+
+// 把content写入临时配置文件，返回文件路径
+static string writeConfig(const string &content)
+{
+    char path[] = "/tmp/serverconfigtestXXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1)
+    {
+        cerr << "can not create temp file" << endl;
+        exit(1);
+    }
+    close(fd);
+    ofstream out(path);
+    out << content;
+    return path;
+}
+
+// 位置参数、默认值和长短选项
+static void testCommandLine()
+{
+    ServerConfig config;
+    string err;
+
+    EXPECT(parse({"127.0.0.1", "6000"}, config, err));
+    EXPECT(config.ip == "127.0.0.1" && config.port == 6000);
+    EXPECT(config.nodeId.empty() && config.ioThreads == -1 && config.workerThreads == -1);
+    EXPECT(!config.reusePort && !config.cpuAffinity && config.corkDelayMs == 0 && !config.relayValidate);
+
+    EXPECT(parse({"127.0.0.1", "6000", "16"}, config, err));
+    EXPECT(config.workerThreads == 16);
+
+    EXPECT(parse({"-i", "0.0.0.0", "-p", "7000", "-t", "8", "-w", "0", "-n", "chat-1", "-d", "2.5"}, config, err));
+    EXPECT(config.ip == "0.0.0.0" && config.port == 7000 && config.ioThreads == 8 && config.workerThreads == 0);
+    EXPECT(config.nodeId == "chat-1" && config.corkDelayMs == 2.5);
+
+    EXPECT(parse({"--ip=10.0.0.1", "--port", "6001", "--io-threads=4", "--node-id", "n1", "--cork-delay-ms=0"}, config, err));
+    EXPECT(config.ip == "10.0.0.1" && config.port == 6001 && config.ioThreads == 4 && config.nodeId == "n1");
+
+    // 选项和位置参数可以混合
+    EXPECT(parse({"-t", "2", "127.0.0.1", "6000"}, config, err));
+    EXPECT(config.ioThreads == 2 && config.port == 6000);
+}
+
+// 布尔选项：不带值表示打开，各种写法的值，后面的选项覆盖前面的
+static void testBoolOptions()
+{
+    ServerConfig config;
+    string err;
+
+    EXPECT(parse({"--reuseport", "--node-id", "n1", "--cpu-affinity", "--relay-validate", "127.0.0.1", "6000"}, config, err));
+    EXPECT(config.reusePort && config.cpuAffinity && config.relayValidate);
+
+    EXPECT(parse({"-r", "-a", "-v", "-n", "n1", "127.0.0.1", "6000"}, config, err));
+    EXPECT(config.reusePort && config.cpuAffinity && config.relayValidate);
+
+    EXPECT(parse({"--reuseport=on", "--cpu-affinity=yes", "--relay-validate=1", "-n", "n1", "127.0.0.1", "6000"}, config, err));
+    EXPECT(config.reusePort && config.cpuAffinity && config.relayValidate);
+
+    EXPECT(parse({"--reuseport", "--reuseport=false", "--cpu-affinity=off", "-v0", "127.0.0.1", "6000"}, config, err));
+    EXPECT(!config.reusePort && !config.cpuAffinity && !config.relayValidate);
+
+    EXPECT(!parse({"--reuseport=maybe", "127.0.0.1", "6000"}, config, err));
+    EXPECT(err.find("reuseport") != string::npos);
+}
+
+// 格式错误的参数
+static void testInvalidCommandLine()
+{
+    ServerConfig config;
+    string err;
+
+    EXPECT(!parse({}, config, err) && !err.empty());
+    EXPECT(!parse({"127.0.0.1"}, config, err) && !err.empty());
+    EXPECT(!parse({"127.0.0.1", "0"}, config, err) && !err.empty());
+    EXPECT(!parse({"127.0.0.1", "65536"}, config, err) && !err.empty());
+    EXPECT(!parse({"127.0.0.1", "60x"}, config, err) && !err.empty());
+    EXPECT(!parse({"127.0.0.1", "6000", "8", "extra"}, config, err) && err.find("extra") != string::npos);
+    EXPECT(!parse({"-t", "-1", "127.0.0.1", "6000"}, config, err) && !err.empty());
+    EXPECT(!parse({"-t", "abc", "127.0.0.1", "6000"}, config, err) && !err.empty());
+    EXPECT(!parse({"-d", "-1", "127.0.0.1", "6000"}, config, err) && !err.empty());
+    EXPECT(!parse({"-n", "", "127.0.0.1", "6000"}, config, err) && !err.empty());
+    EXPECT(!parse({"-n", "a b", "127.0.0.1", "6000"}, config, err) && !err.empty());
+    EXPECT(!parse({"--unknown", "127.0.0.1", "6000"}, config, err) && err.find("--unknown") != string::npos);
+    EXPECT(!parse({"-p"}, config, err) && !err.empty());
+
+    // 多个进程监听同一端口时默认节点id会重复，必须配置节点id
+    EXPECT(!parse({"--reuseport", "127.0.0.1", "6000"}, config, err) && err.find("node_id") != string::npos);
+
+    // --help返回false，err为空，由调用方打印用法
+    EXPECT(!parse({"--help"}, config, err) && err.empty());
+    EXPECT(!parse({"-h", "127.0.0.1", "6000"}, config, err) && err.empty());
+}
+
+// 配置文件：注释、空行、空白、下划线和连字符等价，命令行覆盖配置文件，-c的位置不影响覆盖顺序
+static void testConfigFile()
+{
+    ServerConfig config;
+    string err;
+
+    string path = writeConfig("# chat server\n"
+                              "\n"
+                              "ip = 127.0.0.1\n"
+                              "  port=6000  \n"
+                              "node_id = chat-1\r\n"
+                              "io_threads = 16\n"
+                              "worker-threads = 4\n"
+                              "reuseport = true\n"
+                              "cpu_affinity = false\n"
+                              "cork_delay_ms = 1.5\n"
+                              "relay_validate = no\n");
+    EXPECT(parse({"-c", path}, config, err));
+    EXPECT(config.ip == "127.0.0.1" && config.port == 6000 && config.nodeId == "chat-1");
+    EXPECT(config.ioThreads == 16 && config.workerThreads == 4 && config.reusePort && !config.cpuAffinity);
+    EXPECT(config.corkDelayMs == 1.5 && !config.relayValidate);
+
+    EXPECT(parse({"-t", "2", "--reuseport=false", "--config", path, "-p", "7000"}, config, err));
+    EXPECT(config.ioThreads == 2 && !config.reusePort && config.port == 7000 && config.nodeId == "chat-1");
+
+    EXPECT(parse({"-c", path, "10.0.0.1", "6001"}, config, err));
+    EXPECT(config.ip == "10.0.0.1" && config.port == 6001);
+    remove(path.c_str());
+
+    // 错误信息带上文件名和行号
+    path = writeConfig("ip = 127.0.0.1\nport\n");
+    EXPECT(!parse({"-c", path}, config, err) && err.find(path + ":2") != string::npos);
+    remove(path.c_str());
+
+    path = writeConfig("ip = 127.0.0.1\nport = 6000\nthreads = 4\n");
+    EXPECT(!parse({"-c", path}, config, err) && err.find(":3") != string::npos && err.find("threads") != string::npos);
+    remove(path.c_str());
+
+    path = writeConfig("ip = 127.0.0.1\nport = 6000\nreuseport = 2\n");
+    EXPECT(!parse({"-c", path}, config, err) && err.find(":3") != string::npos);
+    remove(path.c_str());
+
+    // 配置文件打开reuseport但没有节点id
+    path = writeConfig("ip = 127.0.0.1\nport = 6000\nreuseport = true\n");
+    EXPECT(!parse({"-c", path}, config, err) && err.find("node_id") != string::npos);
+    EXPECT(parse({"-c", path, "-n", "chat-2"}, config, err) && config.nodeId == "chat-2");
+    remove(path.c_str());
+
+    EXPECT(!parse({"-c", "/nonexistent/chatserver.conf"}, config, err) && err.find("/nonexistent/chatserver.conf") != string::npos);
+}
+
+int main()
+{
+    testCommandLine();
+    testBoolOptions();
+    testInvalidCommandLine();
+    testConfigFile();
+
+    cout << (_failed == 0 ? "all passed" : "failed " + to_string(_failed)) << endl;
+    return _failed == 0 ? 0 : 1;
+}